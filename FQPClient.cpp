@@ -1,28 +1,71 @@
 #include "FQPClient.h"
 
+#include "FQPCookieJar.h"
+#include "FQPJsonPatch.h"
 #include "FQPRequest.h"
 
 #include <QCoreApplication>
 #include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutexLocker>
 #include <QNetworkAccessManager>
 
 const QByteArray FQPClient::CSRFCookieName = "csrftoken";
 const QByteArray FQPClient::CSRFHeaderName = "X-CSRFTOKEN";
 
+// Backoff for replaying the journal after a transient failure while the
+// network is still up.
+static const int ReplayRetryMs = 1000;
+static const int MaxReplayRetryMs = 60000;
+// With the backoff above, about two minutes of trying.
+static const int DefaultMaxReplayAttempts = 8;
+
+static QJsonValue
+_ValueFromDocument(const QJsonDocument& jsonDoc)
+{
+    if (jsonDoc.isArray()) {
+        return jsonDoc.array();
+    }
+    return jsonDoc.object();
+}
+
+static QJsonDocument
+_DocumentFromValue(const QJsonValue& value)
+{
+    if (value.isArray()) {
+        return QJsonDocument(value.toArray());
+    }
+    return QJsonDocument(value.toObject());
+}
+
 FQPClient::FQPClient(const QUrl& baseUrl, QObject *parent) :
     QThread(parent),
     _baseUrl(baseUrl),
-    _accessManager(_InitAccessManager())
+    _accessManagerReady(false),
+    _networkAccessibility(QNetworkAccessManager::UnknownAccessibility),
+    _startupToFirstResponseMs(-1),
+    _drainScheduled(false),
+    _overflowing(false),
+    _replayTimer(this),
+    _replayFailures(0),
+    _maxReplayAttempts(DefaultMaxReplayAttempts)
 {
+    _startupTimer.start();
+    _replayTimer.setSingleShot(true);
+    connect(&_replayTimer, &QTimer::timeout, this, [this]() {
+            if (_replayingKey.isEmpty()) {
+                _ReplayNext();
+            }
+        });
     _AppendSlashToBaseIfNecessary();
 }
 
 void
 FQPClient::run()
 {
-    // We just re-initialize the access manager so it "belongs" to the
-    // new thread.
-    _accessManager = _InitAccessManager();
+    // Create the access manager here so it "belongs" to the new thread.
+    _GetAccessManager();
     // _eventLoop->exec();
     exec();
 }
@@ -30,15 +73,213 @@ FQPClient::run()
 bool
 FQPClient::IsNetworkAccessible() const
 {
-    return _accessManager->networkAccessible() ==
-        QNetworkAccessManager::Accessible;
+    return _networkAccessibility.load() == QNetworkAccessManager::Accessible;
+}
+
+void
+FQPClient::Preconnect()
+{
+    if (!_accessManagerReady.load(std::memory_order_acquire)) {
+        // Creating it here could make it belong to the wrong thread, if we're
+        // about to be started. By the time our thread's event loop gets to
+        // this, start() has been called if it's going to be.
+        QMetaObject::invokeMethod(this, [this]() { _Preconnect(); },
+                                  Qt::QueuedConnection);
+        return;
+    }
+    _Preconnect();
+}
+
+void
+FQPClient::_Preconnect()
+{
+    QNetworkAccessManagerSharedPtr accessManager = _GetAccessManager();
+    QNetworkAccessManager* manager = accessManager.get();
+    QString host = _baseUrl.host();
+    bool encrypted = (_baseUrl.scheme() == "https");
+    quint16 port = _baseUrl.port(encrypted ? 443 : 80);
+
+    // This has to run on the access manager's thread. The connection is kept
+    // and used by the next request to the host.
+    QMetaObject::invokeMethod(manager, [manager, host, port, encrypted]() {
+#ifndef QT_NO_SSL
+            if (encrypted) {
+                manager->connectToHostEncrypted(host, port);
+                return;
+            }
+#endif
+            manager->connectToHost(host, port);
+        }, Qt::AutoConnection);
+}
+
+qint64
+FQPClient::GetStartupToFirstResponseMs() const
+{
+    return _startupToFirstResponseMs.load();
+}
+
+void
+FQPClient::Sync(const QString& command,
+                const QString& deltaCommand,
+                std::function<void (const QJsonDocument&)> handler)
+{
+    QByteArray version;
+    {
+        QMutexLocker locker(&_syncedResourcesMutex);
+        version = _syncedResources.value(command).version;
+    }
+    if (version.isEmpty() || deltaCommand.isEmpty()) {
+        _SyncFull(command, handler);
+        return;
+    }
+
+    FQPRequestSharedPtr request = _BuildRequest(deltaCommand, "GET",
+                                                QJsonObject());
+    request->SetRawHeader("If-None-Match", version);
+    request->SetRawHeader("Accept",
+                          "application/json-patch+json, "
+                          "application/merge-patch+json, "
+                          "application/json");
+    qDebug() << "(delta) URL: " << request->GetRequest().url();
+    _FetchResponse(request,
+                   [this, command, version, handler](QNetworkReply::NetworkError error,
+                                                     int status,
+                                                     const QByteArray& etag,
+                                                     const QByteArray& contentType,
+                                                     const QByteArray& body) {
+                       if (error == QNetworkReply::NoError) {
+                           if ((status == 304) ||
+                               ((status == 200) &&
+                                _ApplyDelta(command, version, etag,
+                                            contentType, body))) {
+                               handler(_GetSyncedDocument(command));
+                               return;
+                           }
+                       } else {
+                           qDebug() << "error: " << error;
+                       }
+                       qDebug() << "No delta for " << command
+                                << ", fetching all of it";
+                       _SyncFull(command, handler);
+                   });
+}
+
+void
+FQPClient::ResetSync(const QString& command)
+{
+    QMutexLocker locker(&_syncedResourcesMutex);
+    _syncedResources.remove(command);
+}
+
+void
+FQPClient::EnableRequestJournal(const QString& path)
+{
+    _journal = FQPRequestJournalSharedPtr(new FQPRequestJournal(path));
+    ReplayJournal();
+}
+
+void
+FQPClient::SetMaxReplayAttempts(int attempts)
+{
+    _maxReplayAttempts = qMax(1, attempts);
+}
+
+FQPRequestJournalSharedPtr
+FQPClient::GetRequestJournal() const
+{
+    return _journal;
+}
+
+void
+FQPClient::SetMemoryBudget(qint64 budgetBytes, qint64 maxResponseBytes)
+{
+    _memoryBudget = FQPMemoryBudgetSharedPtr(
+        new FQPMemoryBudget(budgetBytes, maxResponseBytes));
+}
+
+FQPMemoryBudgetSharedPtr
+FQPClient::GetMemoryBudget() const
+{
+    return _memoryBudget;
+}
+
+void
+FQPClient::SetCookieStore(const FQPCookieStoreSharedPtr& store)
+{
+    {
+        QMutexLocker locker(&_accessManagerMutex);
+        _cookieStore = store;
+        if (_accessManager) {
+            _accessManager->setCookieJar(new FQPCookieJar(_cookieStore));
+        }
+        // Otherwise, _InitAccessManager() will set it up.
+    }
+    // Pick up the token from the last run, if it's still good.
+    FQPCookieJar cookieJar(_cookieStore);
+    QByteArray token = cookieJar.GetCookieValue(CSRFCookieName, _baseUrl);
+    if (!token.isEmpty()) {
+        QMutexLocker locker(&_csrfTokenMutex);
+        _csrfToken = token;
+    }
+}
+
+void
+FQPClient::ReplayJournal()
+{
+    // The journal's state belongs to our thread. Always queued, so that
+    // replaying what an earlier run left doesn't create the access manager
+    // before we're started (from EnableRequestJournal, say).
+    QMetaObject::invokeMethod(this, [this]() {
+            if (!_journal || !_replayingKey.isEmpty() ||
+                _replayTimer.isActive() || _IsOffline()) {
+                // Already replaying, or waiting to retry, or we'd just fail.
+                return;
+            }
+            _ReplayNext();
+        }, Qt::QueuedConnection);
+}
+
+QNetworkAccessManagerSharedPtr
+FQPClient::_GetAccessManager()
+{
+    // Once it's created, it never changes, so every call after the first few
+    // can skip the lock.
+    if (_accessManagerReady.load(std::memory_order_acquire)) {
+        return _accessManager;
+    }
+    QMutexLocker locker(&_accessManagerMutex);
+    if (!_accessManager) {
+        if (isRunning() && (QThread::currentThread() != this)) {
+            // run() is about to create it on our thread. Creating one here
+            // would belong to the wrong thread.
+            while (!_accessManager) {
+                _accessManagerCreated.wait(&_accessManagerMutex);
+            }
+        } else {
+            _accessManager = _InitAccessManager();
+            _accessManagerReady.store(true, std::memory_order_release);
+            _accessManagerCreated.wakeAll();
+        }
+    }
+    return _accessManager;
 }
 
 QNetworkAccessManagerSharedPtr
 FQPClient::_InitAccessManager()
 {
     QNetworkAccessManager* accessManager = new QNetworkAccessManager();
+    if (_cookieStore) {
+        accessManager->setCookieJar(new FQPCookieJar(_cookieStore));
+    }
 
+    // We're on its thread, so we can ask it. After this, it tells us, and
+    // the other threads read what it told us.
+    _networkAccessibility.store(accessManager->networkAccessible());
+    connect(accessManager,
+            &QNetworkAccessManager::networkAccessibleChanged,
+            [this](QNetworkAccessManager::NetworkAccessibility accessibility) {
+                _networkAccessibility.store(accessibility);
+            });
     connect(accessManager,
             &QNetworkAccessManager::networkAccessibleChanged,
             this, &FQPClient::_OnNetworkAccessibleChanged);
@@ -50,23 +291,282 @@ void
 FQPClient::_QueueRequest(const FQPRequestSharedPtr& request,
                          const FQPReplyHandlerSharedPtr& reply)
 {
-    _requestQueue.enqueue(std::make_pair(request, reply));
-    QThread* accessManagerThread = _accessManager->thread();
-
     connect(reply.get(),&FQPReplyHandler::CSRFTokenUpdated,
             this, &FQPClient::_OnCSRFTokenUpdated);
-    if (accessManagerThread != thread()) {
-        // If we're not multithreaded, moving the thread is a noop, but let's
-        // save a little work and only move if we're in a thread.
-        qDebug() << "request and reply in different thread. Moving";
+    connect(reply.get(), &FQPReplyHandler::PermanentRedirectReceived,
+            this, &FQPClient::_OnPermanentRedirect);
+    QUrl requestUrl = request->GetRequest().url();
+    // Direct, so it's sent before the handler runs.
+    connect(reply.get(), &FQPReplyHandler::Completed,
+            [this, requestUrl](QNetworkReply::NetworkError error) {
+                if (error != QNetworkReply::NoError) {
+                    emit RequestFailed(requestUrl, error);
+                }
+            });
+    if (_memoryBudget) {
+        reply->SetMemoryBudget(_memoryBudget);
+        QUrl url = request->GetRequest().url();
+        connect(reply.get(), &FQPReplyHandler::ResponseTooLarge,
+                this, [this, url](qint64 size, qint64 limit) {
+                    emit ResponseTooLarge(url, size, limit);
+                });
+    }
+    if (_startupToFirstResponseMs.load() < 0) {
+        // Not through the client's thread, so we time the reply itself, not
+        // the event queue.
+        connect(reply.get(), &FQPReplyHandler::Completed,
+                [this](QNetworkReply::NetworkError) {
+                    qint64 notYet = -1;
+                    qint64 elapsed = _startupTimer.elapsed();
+                    if (_startupToFirstResponseMs.compare_exchange_strong(
+                            notYet, elapsed)) {
+                        qDebug() << "FQPClient: first response after "
+                                 << elapsed << "ms";
+                        emit FirstResponseReceived(elapsed);
+                    }
+                });
+    }
+    // Move them while we're still on the thread they were created on. Once
+    // they belong to another thread, only that thread can move them.
+    _MoveToAccessManagerThread(request, reply);
+    if (_journal && request->IsMutating()) {
+        // Send the key even on the first try. If we lose the reply, the server
+        // may have processed it already.
+        if (request->GetIdempotencyKey().isEmpty()) {
+            request->SetIdempotencyKey(FQPRequestJournal::NewKey());
+        }
+        // Unless this is the only try we get.
+        reply->SetDeferTransientFailures(_maxReplayAttempts > 1);
+        connect(reply.get(), &FQPReplyHandler::TransientFailureDeferred,
+                this, [this, request, reply](QNetworkReply::NetworkError) {
+                    _OnTransientFailure(request, reply);
+                });
+        // Whether to send it now or journal it depends on the journal's state,
+        // which belongs to our thread, so decide there.
+        QMetaObject::invokeMethod(this, [this, request, reply]() {
+                if (_IsOffline() || !_journal->IsEmpty() ||
+                    !_replayingKey.isEmpty()) {
+                    // Journaled requests go first, so this one waits its
+                    // turn behind them.
+                    _DeferRequest(request, reply);
+                    ReplayJournal();
+                } else {
+                    _SendRequest(request, reply);
+                }
+            }, Qt::AutoConnection);
+        return;
+    }
+    _SendRequest(request, reply);
+}
+
+void
+FQPClient::_MoveToAccessManagerThread(const FQPRequestSharedPtr& request,
+                                      const FQPReplyHandlerSharedPtr& reply)
+{
+    QThread* accessManagerThread = _GetAccessManager()->thread();
+    // If we're not multithreaded, moving the thread is a noop, but let's save
+    // a little work and only move if we're in a thread.
+    if (reply->thread() != accessManagerThread) {
         reply->moveToThread(accessManagerThread);
         request->moveToThread(accessManagerThread);
-        // Run the request in a separate thread.
-        QMetaObject::invokeMethod(reply.get(),"Request", Qt::AutoConnection);
+    }
+}
+
+void
+FQPClient::_SendRequest(const FQPRequestSharedPtr& request,
+                        const FQPReplyHandlerSharedPtr& reply)
+{
+    QNetworkAccessManagerSharedPtr accessManager = _GetAccessManager();
+
+    // Whichever thread we're submitted from, the access manager's thread
+    // sends it.
+    if (accessManager->thread() != QThread::currentThread()) {
+        std::pair<FQPRequestSharedPtr, FQPReplyHandlerSharedPtr> submission =
+            std::make_pair(request, reply);
+        if (_overflowing.load(std::memory_order_acquire) ||
+            !_submissions.TryPush(submission)) {
+            // The ring is full (or was, and the drain hasn't caught up yet).
+            // Queue behind what's in it, so this thread's requests are still
+            // sent in the order it made them.
+            QMutexLocker locker(&_overflowMutex);
+            _overflowSubmissions.append(submission);
+            _overflowing.store(true, std::memory_order_release);
+        }
+        if (!_drainScheduled.exchange(true)) {
+            QMetaObject::invokeMethod(accessManager.get(),
+                                      [this]() { _DrainSubmissions(); },
+                                      Qt::QueuedConnection);
+        }
     } else {
         reply->Request();
     }
+}
+
+void
+FQPClient::_DrainSubmissions()
+{
+    // Clear the flag before draining. Anything pushed after we've looked
+    // will post another drain.
+    _drainScheduled.store(false);
+    std::pair<FQPRequestSharedPtr, FQPReplyHandlerSharedPtr> submission;
+    while (_submissions.TryPop(submission)) {
+        submission.second->Request();
+    }
+    if (!_overflowing.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (!_submissions.IsEmpty()) {
+        // A push has claimed a cell, but not filled it yet. It may have to go
+        // before the overflow, so come back for both once it's there.
+        if (!_drainScheduled.exchange(true)) {
+            QMetaObject::invokeMethod(_GetAccessManager().get(),
+                                      [this]() { _DrainSubmissions(); },
+                                      Qt::QueuedConnection);
+        }
+        return;
+    }
+    QList<std::pair<FQPRequestSharedPtr, FQPReplyHandlerSharedPtr> > overflow;
+    {
+        QMutexLocker locker(&_overflowMutex);
+        overflow.swap(_overflowSubmissions);
+        _overflowing.store(false, std::memory_order_release);
+    }
+    for (int i = 0 ; i < overflow.size() ; ++i) {
+        overflow[i].second->Request();
+    }
+}
+
+void
+FQPClient::_DeferRequest(const FQPRequestSharedPtr& request,
+                         const FQPReplyHandlerSharedPtr& reply)
+{
+    QByteArray key = request->GetIdempotencyKey();
+    qDebug() << "FQPClient::_DeferRequest(): " << key;
+    if (!_journal->Contains(key)) {
+        FQPRequestJournal::Entry entry;
+        entry.key = key;
+        entry.url = request->GetRequest().url();
+        entry.method = request->GetMethod();
+        entry.content = request->GetContent();
+        _journal->Append(entry);
+    }
+    _deferredRequests.insert(key, std::make_pair(request, reply));
+    if (key == _replayingKey) {
+        // Still can't get through. _RetryLater (or the network coming back)
+        // picks up from here.
+        _replayingKey.clear();
+    }
+}
+
+void
+FQPClient::_OnTransientFailure(const FQPRequestSharedPtr& request,
+                               const FQPReplyHandlerSharedPtr& reply)
+{
+    _failedAttempts[request->GetIdempotencyKey()]++;
+    _DeferRequest(request, reply);
+    _RetryLater();
+}
+
+void
+FQPClient::_RetryLater()
+{
+    if (!_replayingKey.isEmpty() || _replayTimer.isActive()) {
+        // The replay in progress, or the one scheduled, will get to it.
+        return;
+    }
+    if (_IsOffline()) {
+        // _OnNetworkAccessibleChanged replays once we're back.
+        return;
+    }
+    // Back off while we keep failing.
+    int delay = ReplayRetryMs;
+    for (int i = 0 ; (i < _replayFailures) && (delay < MaxReplayRetryMs) ; ++i) {
+        delay *= 2;
+    }
+    delay = qMin(delay, MaxReplayRetryMs);
+    _replayFailures++;
+    qDebug() << "FQPClient: retrying the journal in " << delay << "ms";
+    _replayTimer.start(delay);
+}
+
+bool
+FQPClient::_IsOffline() const
+{
+    // Until the access manager exists, we don't know, so we try.
+    return _networkAccessibility.load() == QNetworkAccessManager::NotAccessible;
+}
+
+void
+FQPClient::_ReplayNext()
+{
+    QList<FQPRequestJournal::Entry> pending = _journal->GetPending();
+    if (pending.isEmpty()) {
+        return;
+    }
+    const FQPRequestJournal::Entry& entry = pending.first();
+    QByteArray key = entry.key;
+    FQPRequestSharedPtr request;
+    FQPReplyHandlerSharedPtr reply;
 
+    auto it = _deferredRequests.find(key);
+    if (it != _deferredRequests.end()) {
+        request = it->first;
+        reply = it->second;
+        _deferredRequests.erase(it);
+        // The token may have changed since we built the request (likely, if
+        // we were offline for a while), and the server would refuse the old
+        // one.
+        QByteArray token = _GetCSRFToken();
+        if (!token.isEmpty()) {
+            request->SetRawHeader(CSRFHeaderName, token);
+        }
+    } else {
+        // Journaled by an earlier run, so there's no handler waiting for it.
+        QJsonObject content = QJsonDocument::fromJson(entry.content).object();
+        request = FQPRequestSharedPtr(new FQPRequest(entry.url, entry.method,
+                                                     content,
+                                                     _GetCSRFToken()));
+        request->SetIdempotencyKey(key);
+        reply = FQPReplyHandlerSharedPtr(
+            new FQPReplyHandler(_GetAccessManager(), request));
+        reply->SetDeferTransientFailures(true);
+        reply->SetMemoryBudget(_memoryBudget);
+        connect(reply.get(),&FQPReplyHandler::CSRFTokenUpdated,
+                this, &FQPClient::_OnCSRFTokenUpdated);
+        QUrl url = entry.url;
+        connect(reply.get(), &FQPReplyHandler::Completed,
+                [this, url](QNetworkReply::NetworkError error) {
+                    if (error != QNetworkReply::NoError) {
+                        emit RequestFailed(url, error);
+                    }
+                });
+        connect(reply.get(), &FQPReplyHandler::TransientFailureDeferred,
+                this, [this, request, reply](QNetworkReply::NetworkError) {
+                    _OnTransientFailure(request, reply);
+                });
+        _MoveToAccessManagerThread(request, reply);
+    }
+    if (_failedAttempts.value(key) >= _maxReplayAttempts - 1) {
+        // The last try. If it fails too, the error goes to Completed (and the
+        // handler) like any other, and we take it out of the journal below.
+        qDebug() << "FQPClient: last attempt for " << key;
+        reply->SetDeferTransientFailures(false);
+    }
+    _replayingKey = key;
+    connect(reply.get(), &FQPReplyHandler::Completed,
+            this, [this, key](QNetworkReply::NetworkError error) {
+                if (key != _replayingKey) {
+                    // From an earlier replay of the same request.
+                    return;
+                }
+                _journal->MarkDone(key);
+                _failedAttempts.remove(key);
+                _replayingKey.clear();
+                _replayFailures = 0;
+                emit JournaledRequestReplayed(key, error);
+                _ReplayNext();
+            });
+    _SendRequest(request, reply);
 }
 
 void
@@ -79,6 +579,137 @@ FQPClient::_AppendSlashToBaseIfNecessary()
     }
 }
 
+void
+FQPClient::_FetchResponse(const FQPRequestSharedPtr& request,
+                          ResponseHandler handler)
+{
+    FQPReplyHandlerSharedPtr reply =
+        FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
+                                                     request));
+    reply->SetDeliverResponse(true);
+    connect(reply.get(), &FQPReplyHandler::ResponseReceived,
+            [request, reply, handler](QNetworkReply::NetworkError error,
+                                      int status,
+                                      const QByteArray& etag,
+                                      const QByteArray& contentType,
+                                      const QByteArray& body) {
+                handler(error, status, etag, contentType, body);
+            });
+    _QueueRequest(request, reply);
+}
+
+void
+FQPClient::_SyncFull(const QString& command,
+                     std::function<void (const QJsonDocument&)> handler)
+{
+    FQPRequestSharedPtr request = _BuildRequest(command, "GET", QJsonObject());
+    qDebug() << "(sync) URL: " << request->GetRequest().url();
+    _FetchResponse(request,
+                   [this, command, handler](QNetworkReply::NetworkError error,
+                                            int /*status*/,
+                                            const QByteArray& etag,
+                                            const QByteArray& /*contentType*/,
+                                            const QByteArray& body) {
+                       QJsonDocument jsonDoc = QJsonDocument::fromJson(body);
+                       if ((error != QNetworkReply::NoError) || jsonDoc.isNull()) {
+                           qDebug() << "error: " << error;
+                           handler(QJsonDocument());
+                           return;
+                       }
+                       {
+                           QMutexLocker locker(&_syncedResourcesMutex);
+                           SyncedResource& resource = _syncedResources[command];
+                           resource.root = _ValueFromDocument(jsonDoc);
+                           resource.version = etag;
+                       }
+                       handler(jsonDoc);
+                   });
+}
+
+bool
+FQPClient::_ApplyDelta(const QString& command,
+                       const QByteArray& baseVersion,
+                       const QByteArray& version,
+                       const QByteArray& contentType,
+                       const QByteArray& body)
+{
+    QByteArray mimeType = contentType.split(';').first().trimmed().toLower();
+    QJsonParseError parseError;
+    QJsonDocument delta = QJsonDocument::fromJson(body, &parseError);
+    if (delta.isNull()) {
+        qDebug() << "Unable to parse the delta for " << command << ": "
+                 << parseError.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&_syncedResourcesMutex);
+    auto it = _syncedResources.find(command);
+    if ((it == _syncedResources.end()) || (it->version != baseVersion)) {
+        // Someone else synced (or reset) it while we were waiting.
+        return false;
+    }
+    // We edit the stored version where it is, which still copies it (once per
+    // operation), but we never parse it again.
+    if (mimeType == "application/json-patch+json") {
+        if (!delta.isArray() || !FQPJson_ApplyPatch(it->root, delta.array())) {
+            return false;
+        }
+    } else if (mimeType == "application/merge-patch+json") {
+        FQPJson_ApplyMergePatch(it->root, _ValueFromDocument(delta));
+    } else {
+        // The server sent all of it instead.
+        it->root = _ValueFromDocument(delta);
+    }
+    it->version = version;
+    return true;
+}
+
+QJsonDocument
+FQPClient::_GetSyncedDocument(const QString& command)
+{
+    QMutexLocker locker(&_syncedResourcesMutex);
+    return _DocumentFromValue(_syncedResources.value(command).root);
+}
+
+FQPSubscriptionSharedPtr
+FQPClient::_BuildSubscription(const QString& command)
+{
+    QNetworkRequest request =
+        _BuildRequest(command, "GET", QJsonObject())->GetRequest();
+    // It lives on the access manager's thread, so it has to be deleted there.
+    FQPSubscriptionSharedPtr subscription(
+        new FQPSubscription(_GetAccessManager(), request),
+        [](FQPSubscription* subscription) { subscription->deleteLater(); });
+    subscription->SetMemoryBudget(_memoryBudget);
+    return subscription;
+}
+
+void
+FQPClient::_OpenSubscription(const FQPSubscriptionSharedPtr& subscription)
+{
+    QThread* accessManagerThread = _GetAccessManager()->thread();
+    if (subscription->thread() != accessManagerThread) {
+        subscription->moveToThread(accessManagerThread);
+    }
+    QMetaObject::invokeMethod(subscription.get(), "Open", Qt::AutoConnection);
+}
+
+QUrl
+FQPClient::_ResolvePermanentRedirects(const QUrl& url)
+{
+    QMutexLocker locker(&_permanentRedirectsMutex);
+    QUrl resolved = url;
+    // Same limit as the reply handler, which also keeps us out of cycles.
+    for (int hop = 0 ; hop < FQPReplyHandler::MaxRedirects ; ++hop) {
+        auto it = _permanentRedirects.constFind(resolved);
+        if (it == _permanentRedirects.constEnd()) {
+            break;
+        }
+        resolved = it.value();
+    }
+    return resolved;
+}
+
 FQPRequestSharedPtr
 FQPClient::_BuildRequest(const QString& command,
                          const QByteArray& method,
@@ -101,20 +732,51 @@ FQPClient::_BuildRequest(const QString& command,
     }
     
     requestUrl.setPath(requestPath);
+    requestUrl = _ResolvePermanentRedirects(requestUrl);
 
     return FQPRequestSharedPtr(new FQPRequest(requestUrl, method, content,
-                                              _csrfToken));
+                                              _GetCSRFToken()));
 }
 
 void
 FQPClient::_OnNetworkAccessibleChanged(QNetworkAccessManager::NetworkAccessibility accessibility)
 {
     qDebug() << "FQPClient::_OnNetworkAccessibleChanged(): " << accessibility;
+    if (accessibility == QNetworkAccessManager::Accessible) {
+        // A new network, so don't wait out the backoff from the old one.
+        _replayTimer.stop();
+        _replayFailures = 0;
+        ReplayJournal();
+    }
 }
 
- void
- FQPClient::_OnCSRFTokenUpdated(const QByteArray& token)
- {
-     _csrfToken = token;
- }
+QByteArray
+FQPClient::_GetCSRFToken() const
+{
+    QMutexLocker locker(&_csrfTokenMutex);
+    return _csrfToken;
+}
 
+void
+FQPClient::_OnCSRFTokenUpdated(const QByteArray& token)
+{
+    QMutexLocker locker(&_csrfTokenMutex);
+    // Every request that was in flight when the token rotated reports the
+    // new one, so only the first is news.
+    if (token == _csrfToken) {
+        return;
+    }
+    qDebug() << "FQPClient: CSRF token updated";
+    _csrfToken = token;
+}
+
+void
+FQPClient::_OnPermanentRedirect(const QUrl& from, const QUrl& to)
+{
+    if (!FQPReplyHandler::IsSameOrigin(from, to)) {
+        // We'd be sending every later request (and its token) elsewhere.
+        return;
+    }
+    QMutexLocker locker(&_permanentRedirectsMutex);
+    _permanentRedirects.insert(from, to);
+}
@@ -3,8 +3,13 @@
 
 #include <QObject>
 
+#include "FQPFuture.h"
+#include "FQPMemoryBudget.h"
 #include "FQPReplyHandler.h"
 #include "FQPRequest.h"
+#include "FQPRequestJournal.h"
+#include "FQPSubmissionRing.h"
+#include "FQPSubscription.h"
 #include "FQPTypes.h"
 
 #include <QThread>
@@ -12,19 +17,29 @@
 #include <QString>
 #include <QUrl>
 
-#include <QQueue>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
 #include <QVector>
+#include <QWaitCondition>
 
 // JSON stuff
 #include <QJsonObject>
+#include <QJsonValue>
 #include <QStringList>
 
+#include <atomic>
 #include <functional>
 
 FQP_DECLARE_PTRS(QNetworkAccessManager)
 FQP_DECLARE_PTRS(QEventLoop)
 FQP_DECLARE_PTRS(FQPReplyHandler)
 FQP_DECLARE_PTRS(FQPRequest)
+FQP_DECLARE_PTRS(FQPRequestJournal)
+FQP_DECLARE_PTRS(FQPCookieStore)
+FQP_DECLARE_PTRS(FQPSubscription)
+FQP_DECLARE_PTRS(FQPMemoryBudget)
 
 // Inherited from thread, but we don't have to run as a thread.
 class FQPClient : public QThread
@@ -37,13 +52,156 @@ public:
 
     // Only necessary to call if we want to run this in a separate thread.
     // XXX - This seems like it works in the simulator, but not iOS.
+    // Start the thread before making any requests, since the access manager
+    // is created by whichever comes first, and belongs to that thread. The
+    // calls that don't make requests (IsNetworkAccessible, Preconnect,
+    // EnableRequestJournal, ReplayJournal) are fine before start(), as long
+    // as start() is called before we get back to the event loop.
     virtual void run() override;
 
     // Constructs a client to communicate with the base URL.
     explicit FQPClient(const QUrl& baseUrl, QObject *parent = 0);
 
+    // What the access manager last told us. False until it exists (the
+    // first request, or start()), since we don't know yet. Safe to call from
+    // any thread.
     bool IsNetworkAccessible() const;
 
+    // Journals mutating requests that can't be sent (we're offline, or the
+    // send failed transiently) to the file at path, and replays them in order
+    // when the network comes back, or after a backoff if it never went away.
+    // While anything is journaled, new mutating requests queue behind it.
+    // Their handlers are called once the replay finishes. A request that
+    // still fails transiently after the maximum number of attempts is taken
+    // out of the journal, and its error delivered like any other (its
+    // handler, RequestFailed and JournaledRequestReplayed), so it can't hold
+    // up the ones behind it forever. Requests left in the journal by an
+    // earlier run are replayed too, but no one is waiting on those, so we
+    // just emit JournaledRequestReplayed. Throws FQPException if the journal
+    // can't be opened.
+    void EnableRequestJournal(const QString& path);
+
+    // How many times a journaled request is sent (counting the first try)
+    // before we give up on it (8 by default). Call this before making
+    // requests.
+    void SetMaxReplayAttempts(int attempts);
+
+    FQPRequestJournalSharedPtr GetRequestJournal() const;
+
+    // Opens a stream that the server pushes events down (Server-Sent Events,
+    // or one JSON document per line) instead of polling command with Fetch.
+    // handler is called with each event of eventType (every event, if
+    // eventType is empty), parsed as JSON. The stream stays open, reconnecting
+    // as needed, until the returned subscription is released.
+    FQPSubscriptionSharedPtr Subscribe(const QString& command,
+                                       const QByteArray& eventType,
+                                       std::function<void (const QJsonDocument&)> handler) {
+        FQPSubscriptionSharedPtr subscription = _BuildSubscription(command);
+        connect(subscription.get(), &FQPSubscription::EventReceived,
+                [eventType, handler](const QByteArray& type,
+                                     const QByteArray& /*id*/,
+                                     const QByteArray& data) {
+                    if (!eventType.isEmpty() && (type != eventType)) {
+                        return;
+                    }
+                    handler(QJsonDocument::fromJson(data));
+                });
+        _OpenSubscription(subscription);
+        return subscription;
+    }
+
+    // As above, but handler is called with the value of the first of the
+    // resultParameters in each event. Throws FQPException if there isn't
+    // one.
+    template <typename S>
+    FQPSubscriptionSharedPtr Subscribe(const QString& command,
+                                       const QByteArray& eventType,
+                                       const QStringList* resultParameters,
+                                       std::function<void (S)> handler) {
+        if (!resultParameters || resultParameters->isEmpty()) {
+            throw FQPException("Subscribe needs a result parameter");
+        }
+        QString key = resultParameters->first();
+        FQPSubscriptionSharedPtr subscription = _BuildSubscription(command);
+        connect(subscription.get(), &FQPSubscription::EventReceived,
+                [eventType, key, handler](const QByteArray& type,
+                                          const QByteArray& /*id*/,
+                                          const QByteArray& data) {
+                    if (!eventType.isEmpty() && (type != eventType)) {
+                        return;
+                    }
+                    QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
+                    if (!jsonDoc.isObject()) {
+                        qDebug() << "Event isn't an object: " << data;
+                        return;
+                    }
+                    try {
+                        handler(FQPType_GetValueFromVariant<S>(
+                                    jsonDoc.object().value(key).toVariant()));
+                    } catch (const FQPTypeException& e) {
+                        qDebug() << e.errorString();
+                    }
+                });
+        _OpenSubscription(subscription);
+        return subscription;
+    }
+
+    // Keeps the last version of the resource at command (the body, and the
+    // ETag it came with), and calls handler with the current version. The
+    // first time, or when there's no delta, we fetch all of it. After that, we
+    // GET deltaCommand with the ETag in If-None-Match. The server answers 304
+    // if nothing has changed, or with what has changed since that version, as
+    // a JSON Patch (application/json-patch+json) or a merge patch
+    // (application/merge-patch+json), which we apply to the stored version.
+    // It can also just send the whole thing (application/json). If the delta
+    // fails, or doesn't apply, we fall back to fetching all of it. handler
+    // gets an empty document if that fails too.
+    //
+    // What we download and parse scales with the delta. Applying it doesn't:
+    // Qt's JSON types keep a document as one blob, so each patch operation
+    // copies the stored version once (no parsing, just the copy).
+    void Sync(const QString& command,
+              const QString& deltaCommand,
+              std::function<void (const QJsonDocument&)> handler);
+
+    // Forgets the stored version, so the next Sync fetches all of it.
+    void ResetSync(const QString& command);
+
+    // Resolves the base host and opens a connection to it (with the TLS
+    // handshake, for https) in the background, so the first request doesn't
+    // have to wait for that. Can be called before start(): if there's no
+    // access manager yet, we wait for our event loop, so it's created on the
+    // right thread.
+    void Preconnect();
+
+    // Milliseconds from constructing the client to the first finished reply,
+    // or -1 if we haven't had one yet.
+    qint64 GetStartupToFirstResponseMs() const;
+
+    // Caps the memory held by response buffers across all in-flight requests
+    // at budgetBytes, and any one response at maxResponseBytes (0 for no
+    // limit). Responses are checked against their Content-Length before we
+    // read them, when the server sends one. While the budget is used up, we
+    // stop reading from the sockets until buffers are freed. A response over
+    // the maximum fails with UnknownContentError, after ResponseTooLarge.
+    // Subscriptions count what they've read of an event that hasn't ended
+    // yet, and maxResponseBytes caps that too. Call this before making
+    // requests.
+    void SetMemoryBudget(qint64 budgetBytes, qint64 maxResponseBytes);
+
+    // For the metrics (in use, high-water mark, ...). Null if there's no
+    // budget.
+    FQPMemoryBudgetSharedPtr GetMemoryBudget() const;
+
+    // Keeps the cookies (the CSRF token among them) in store between runs, so
+    // that after a restart we already have the token and don't need a round
+    // trip to get it. Call this before starting the thread.
+    void SetCookieStore(const FQPCookieStoreSharedPtr& store);
+
+    // Replays the journal now. We do this ourselves when the network becomes
+    // accessible. Safe to call from any thread.
+    void ReplayJournal();
+
     // Makes a request with the command to be appended to the baseUrl.
     // The method is one of the HTTP methods.
     // parameters is the JSON parameters to send as part of the request.
@@ -51,6 +209,9 @@ public:
     // Some special values for the parameters: NULL for a handler that
     // takes no parameters, and an empty list to pass the raw results to
     // the handler, doing no handling of the results.
+    // Handlers are always called. When a request fails with nothing to
+    // interpret, RequestFailed is emitted first, and the typed handlers get
+    // default-constructed values.
     // XXX Quite hacky, but we have to have a version for 1..n arguments.
     void FetchRaw(const QString& command,
                   const QByteArray& method,
@@ -61,7 +222,7 @@ public:
         qDebug() << "raw URL: " << request->GetRequest().url();
         QStringList rawParams;
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request, &rawParams));
         // We need to keep a reference to the reply around. We need some kind of
         // cleanup in the closure to get rid of any resources that were created
@@ -88,7 +249,7 @@ public:
                                                     parameters);
         qDebug() << "URL: " << request->GetRequest().url();
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request));
         // We need to keep a reference to the reply around. We need some kind of
         // cleanup in the closure to get rid of any resources that were created
@@ -113,7 +274,7 @@ public:
                                                     parameters);
         qDebug() << "(One arg version)URL: " << request->GetRequest().url();
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request,
                                                          resultParameters));
         connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
@@ -122,6 +283,12 @@ public:
                     if (error != QNetworkReply::NoError) {
                         qDebug() << "error: " << error;
                     }
+                    if (results.isEmpty()) {
+                        // Nothing came back to interpret. RequestFailed has
+                        // the error.
+                        handler(FQPType_DefaultValue<S>());
+                        return;
+                    }
                     // Only one element
                     S val = FQPType_GetValueFromVariant<S>(results[0]);
                     handler(val);
@@ -140,7 +307,7 @@ public:
                                                     parameters);
         qDebug() << "(Two arg version)URL: " << request->GetRequest().url();
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request,
                                                          resultParameters));
         connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
@@ -149,6 +316,13 @@ public:
                     if (error != QNetworkReply::NoError) {
                         qDebug() << "error: " << error;
                     }
+                    if (results.isEmpty()) {
+                        // Nothing came back to interpret. RequestFailed has
+                        // the error.
+                        handler(FQPType_DefaultValue<S>(),
+                                FQPType_DefaultValue<T>());
+                        return;
+                    }
                     // Only one element
                     S v0 = FQPType_GetValueFromVariant<S>(results[0]);
                     T v1 = FQPType_GetValueFromVariant<T>(results[1]);
@@ -169,15 +343,23 @@ public:
                                                     parameters);
         qDebug() << "(three arg version)URL: " << request->GetRequest().url();
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request,
                                                          resultParameters));
         connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
-                [request, handler] (QNetworkReply::NetworkError error,
-                                    const QVariantList& results) {
+                [request, reply, handler] (QNetworkReply::NetworkError error,
+                                           const QVariantList& results) {
                     if (error != QNetworkReply::NoError) {
                         qDebug() << "error: " << error;
                     }
+                    if (results.isEmpty()) {
+                        // Nothing came back to interpret. RequestFailed has
+                        // the error.
+                        handler(FQPType_DefaultValue<S>(),
+                                FQPType_DefaultValue<T>(),
+                                FQPType_DefaultValue<U>());
+                        return;
+                    }
                     // Only one element
                     S v0 = FQPType_GetValueFromVariant<S>(results[0]);
                     T v1 = FQPType_GetValueFromVariant<T>(results[1]);
@@ -200,7 +382,7 @@ public:
                                                     parameters);
         qDebug() << "(four arg version)URL: " << request->GetRequest().url();
         FQPReplyHandlerSharedPtr reply =
-            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_accessManager,
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
                                                          request,
                                                          resultParameters));
         connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
@@ -209,23 +391,232 @@ public:
                     if (error != QNetworkReply::NoError) {
                         qDebug() << "error: " << error;
                     }
+                    if (results.isEmpty()) {
+                        // Nothing came back to interpret. RequestFailed has
+                        // the error.
+                        handler(FQPType_DefaultValue<S>(),
+                                FQPType_DefaultValue<T>(),
+                                FQPType_DefaultValue<U>(),
+                                FQPType_DefaultValue<V>());
+                        return;
+                    }
                     // Only one element
                     S v0 = FQPType_GetValueFromVariant<S>(results[0]);
                     T v1 = FQPType_GetValueFromVariant<T>(results[1]);
                     U v2 = FQPType_GetValueFromVariant<U>(results[2]);
-                    V v3 = FQPType_GetValueFromVariant<U>(results[3]);
+                    V v3 = FQPType_GetValueFromVariant<V>(results[3]);
                     handler(v0, v1, v2, v3);
                 });
         _QueueRequest(request, reply);
     }
 
+    // Future versions of the calls above. Independent requests can all be
+    // started and then joined with FQPWhenAll or FQPWhenAny, rather than
+    // nesting the handlers and sending them one after the other. A request
+    // that fails (or whose results can't be converted, or that has no object
+    // to take the result parameters from) cancels its future.
+    QFuture<QJsonDocument> FetchRawAsync(const QString& command,
+                                         const QByteArray& method,
+                                         const QJsonObject& parameters) {
+        FQPRequestSharedPtr request = _BuildRequest(command, method,
+                                                    parameters);
+        qDebug() << "(async) raw URL: " << request->GetRequest().url();
+        QStringList rawParams;
+        FQPReplyHandlerSharedPtr reply =
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
+                                                         request, &rawParams));
+        QFutureInterface<QJsonDocument> promise;
+        promise.reportStarted();
+        connect(reply.get(), &FQPReplyHandler::RawReplyReceived,
+                [request, reply, promise](QNetworkReply::NetworkError error,
+                                          const QJsonDocument& jsonDoc) mutable {
+                    if (error != QNetworkReply::NoError) {
+                        qDebug() << "error: " << error;
+                        promise.reportCanceled();
+                    } else {
+                        promise.reportResult(jsonDoc);
+                    }
+                    promise.reportFinished();
+                });
+        _QueueRequest(request, reply);
+        return promise.future();
+    }
+
+    QFuture<void> FetchAsync(const QString& command,
+                             const QByteArray& method,
+                             const QJsonObject& parameters) {
+        FQPRequestSharedPtr request = _BuildRequest(command, method,
+                                                    parameters);
+        qDebug() << "(async) URL: " << request->GetRequest().url();
+        FQPReplyHandlerSharedPtr reply =
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
+                                                         request));
+        QFutureInterface<void> promise;
+        promise.reportStarted();
+        connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
+                [request, reply, promise](QNetworkReply::NetworkError error) mutable {
+                    if (error != QNetworkReply::NoError) {
+                        qDebug() << "error: " << error;
+                        promise.reportCanceled();
+                    }
+                    promise.reportFinished();
+                });
+        _QueueRequest(request, reply);
+        return promise.future();
+    }
+
+    // The values of all of the resultParameters, in order.
+    QFuture<QVariantList> FetchValuesAsync(const QString& command,
+                                           const QByteArray& method,
+                                           const QJsonObject& parameters,
+                                           const QStringList* resultParameters) {
+        FQPRequestSharedPtr request = _BuildRequest(command, method,
+                                                    parameters);
+        qDebug() << "(async values) URL: " << request->GetRequest().url();
+        FQPReplyHandlerSharedPtr reply =
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
+                                                         request,
+                                                         resultParameters));
+        QFutureInterface<QVariantList> promise;
+        promise.reportStarted();
+        connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
+                [request, reply, promise] (QNetworkReply::NetworkError error,
+                                           const QVariantList& results) mutable {
+                    if (error != QNetworkReply::NoError) {
+                        qDebug() << "error: " << error;
+                        promise.reportCanceled();
+                    } else {
+                        promise.reportResult(results);
+                    }
+                    promise.reportFinished();
+                });
+        _QueueRequest(request, reply);
+        return promise.future();
+    }
+
+    // The value of the first of the resultParameters.
+    template <typename S>
+    QFuture<S> FetchAsync(const QString& command,
+                          const QByteArray& method,
+                          const QJsonObject& parameters,
+                          const QStringList* resultParameters) {
+        FQPRequestSharedPtr request = _BuildRequest(command, method,
+                                                    parameters);
+        qDebug() << "(async one arg version)URL: "
+                 << request->GetRequest().url();
+        FQPReplyHandlerSharedPtr reply =
+            FQPReplyHandlerSharedPtr(new FQPReplyHandler(_GetAccessManager(),
+                                                         request,
+                                                         resultParameters));
+        QFutureInterface<S> promise;
+        promise.reportStarted();
+        connect(reply.get(), &FQPReplyHandler::InterpretedReplyReceived,
+                [request, reply, promise] (QNetworkReply::NetworkError error,
+                                           const QVariantList& results) mutable {
+                    if ((error != QNetworkReply::NoError) || results.isEmpty()) {
+                        qDebug() << "error: " << error;
+                        promise.reportCanceled();
+                    } else {
+                        try {
+                            promise.reportResult(
+                                FQPType_GetValueFromVariant<S>(results[0]));
+                        } catch (const FQPTypeException& e) {
+                            qDebug() << e.errorString();
+                            promise.reportCanceled();
+                        }
+                    }
+                    promise.reportFinished();
+                });
+        _QueueRequest(request, reply);
+        return promise.future();
+    }
+
 signals:
+    // Sent for every request that finishes with an error, just before its
+    // handler is called.
+    void RequestFailed(const QUrl& url, QNetworkReply::NetworkError error);
+
+    // Sent once, for the first finished reply.
+    void FirstResponseReceived(qint64 msecsSinceStartup);
+
+    void ResponseTooLarge(const QUrl& url, qint64 size, qint64 limit);
+
+    void JournaledRequestReplayed(const QByteArray& idempotencyKey,
+                                  QNetworkReply::NetworkError error);
 
 protected:
+    // Creates the access manager the first time it's needed, on the thread
+    // that will own it. If we're running as a thread, that's always ours, so
+    // other threads wait for run() to create it.
+    QNetworkAccessManagerSharedPtr _GetAccessManager();
     QNetworkAccessManagerSharedPtr _InitAccessManager();
 
     void _QueueRequest(const FQPRequestSharedPtr& request,
                        const FQPReplyHandlerSharedPtr& reply);
+    // Has to be called on the thread they were created on.
+    void _MoveToAccessManagerThread(const FQPRequestSharedPtr& request,
+                                    const FQPReplyHandlerSharedPtr& reply);
+
+    // Sends the request on the access manager's thread. Safe to call from any
+    // thread.
+    void _SendRequest(const FQPRequestSharedPtr& request,
+                      const FQPReplyHandlerSharedPtr& reply);
+
+    // The journal's state (_deferredRequests, _replayingKey) is only touched
+    // on our thread, the one this object belongs to, so these have to be
+    // called there.
+
+    // Journals the request (if it isn't already) to be replayed later.
+    void _DeferRequest(const FQPRequestSharedPtr& request,
+                       const FQPReplyHandlerSharedPtr& reply);
+    // Counts the failed attempt, journals the request and schedules a retry.
+    void _OnTransientFailure(const FQPRequestSharedPtr& request,
+                             const FQPReplyHandlerSharedPtr& reply);
+
+    void _ReplayNext();
+    // Schedules a replay, backing off while we keep failing, after a
+    // transient failure while the network is still up.
+    void _RetryLater();
+    bool _IsOffline() const;
+
+    // Preconnect, once we know which thread the access manager belongs to.
+    void _Preconnect();
+
+    typedef std::function<void (QNetworkReply::NetworkError error,
+                                int status,
+                                const QByteArray& etag,
+                                const QByteArray& contentType,
+                                const QByteArray& body)> ResponseHandler;
+
+    // Sends the request and calls handler with the response as it came,
+    // uninterpreted.
+    void _FetchResponse(const FQPRequestSharedPtr& request,
+                        ResponseHandler handler);
+
+    void _SyncFull(const QString& command,
+                   std::function<void (const QJsonDocument&)> handler);
+    // Applies a delta response to the stored version of command, if it's
+    // still baseVersion. Returns false if it doesn't apply.
+    bool _ApplyDelta(const QString& command,
+                     const QByteArray& baseVersion,
+                     const QByteArray& version,
+                     const QByteArray& contentType,
+                     const QByteArray& body);
+    QJsonDocument _GetSyncedDocument(const QString& command);
+
+    FQPSubscriptionSharedPtr _BuildSubscription(const QString& command);
+    // Opens it on the access manager's thread.
+    void _OpenSubscription(const FQPSubscriptionSharedPtr& subscription);
+
+    // Where a request for url ends up, following the permanent redirects
+    // we've seen.
+    QUrl _ResolvePermanentRedirects(const QUrl& url);
+
+    QByteArray _GetCSRFToken() const;
+
+    // Runs on the access manager's thread. Sends everything that's been
+    // submitted since the last drain: the ring, then the overflow.
+    void _DrainSubmissions();
 
 
     void _AppendSlashToBaseIfNecessary();
@@ -242,18 +633,77 @@ protected slots:
     virtual void _OnNetworkAccessibleChanged(QNetworkAccessManager::NetworkAccessibility accessibility);
 
     virtual void _OnCSRFTokenUpdated(const QByteArray& token);
+
+    virtual void _OnPermanentRedirect(const QUrl& from, const QUrl& to);
     
 private:
     QUrl _baseUrl;
+    FQPCookieStoreSharedPtr _cookieStore;
+    // 301s and 308s we've followed, so the next request to the same URL goes
+    // straight to where it was redirected.
+    QHash<QUrl, QUrl> _permanentRedirects;
+    QMutex _permanentRedirectsMutex;
+
+    // Null until _GetAccessManager() creates it, and never changed after.
     QNetworkAccessManagerSharedPtr _accessManager;
+    QMutex _accessManagerMutex;
+    QWaitCondition _accessManagerCreated;
+    // Set (with release) once _accessManager is, so readers can skip the
+    // mutex.
+    std::atomic<bool> _accessManagerReady;
+    // The access manager's networkAccessible(), which only its thread may
+    // ask. Unknown until it's created.
+    std::atomic<int> _networkAccessibility;
+
+    FQPMemoryBudgetSharedPtr _memoryBudget;
+
+    // What Sync keeps of each resource.
+    struct SyncedResource {
+        QJsonValue root;
+        // The ETag it came with.
+        QByteArray version;
+    };
+    QHash<QString, SyncedResource> _syncedResources;
+    QMutex _syncedResourcesMutex;
+
+    QElapsedTimer _startupTimer;
+    std::atomic<qint64> _startupToFirstResponseMs;
+    // Read by _BuildRequest on whichever thread makes the request, and
+    // updated on ours.
     QByteArray _csrfToken;
+    mutable QMutex _csrfTokenMutex;
 
     // Only valid (and needed) when we run as a separate thread. Thus, it's
     // the flag for running as a thread.
     QEventLoopSharedPtr _eventLoop;
 
-    QQueue<std::pair<FQPRequestSharedPtr,
-                     FQPReplyHandlerSharedPtr> > _requestQueue;
+    // Requests submitted from other threads, waiting for the access
+    // manager's thread to send them. We only post one drain for however many
+    // requests are submitted before it runs.
+    FQPSubmissionRing<std::pair<FQPRequestSharedPtr,
+                                FQPReplyHandlerSharedPtr> > _submissions;
+    std::atomic<bool> _drainScheduled;
+    // Where submissions go while the ring is full, and after, until a drain
+    // has emptied the ring. Any thread's later requests go here too, rather
+    // than overtaking its earlier ones.
+    QList<std::pair<FQPRequestSharedPtr,
+                    FQPReplyHandlerSharedPtr> > _overflowSubmissions;
+    QMutex _overflowMutex;
+    std::atomic<bool> _overflowing;
+
+    FQPRequestJournalSharedPtr _journal;
+    // The journaled requests from this run, by idempotency key, so we can
+    // call their handlers when they're replayed.
+    QHash<QByteArray, std::pair<FQPRequestSharedPtr,
+                                FQPReplyHandlerSharedPtr> > _deferredRequests;
+    // Empty unless we're waiting on a replay.
+    QByteArray _replayingKey;
+    QTimer _replayTimer;
+    // Transient failures since the last successful replay.
+    int _replayFailures;
+    // Failed attempts of each journaled request, this run.
+    QHash<QByteArray, int> _failedAttempts;
+    int _maxReplayAttempts;
 };
 
 #endif // FQPCLIENT_H
@@ -27,15 +27,29 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
     FQPClient.cpp \
+    FQPCookieJar.cpp \
+    FQPCookieStore.cpp \
+    FQPJsonPatch.cpp \
+    FQPMemoryBudget.cpp \
     FQPReplyHandler.cpp \
     FQPRequest.cpp \
+    FQPRequestJournal.cpp \
+    FQPSubscription.cpp \
 
 HEADERS +=\
         fqpclient_global.h \
         FQPClient.h \
+        FQPCookieJar.h \
+        FQPCookieStore.h \
         FQPTypes.h \
+        FQPFuture.h \
+        FQPJsonPatch.h \
+        FQPMemoryBudget.h \
         FQPReplyHandler.h \
         FQPRequest.h \
+        FQPRequestJournal.h \
+        FQPSubmissionRing.h \
+        FQPSubscription.h \
 
 android {
     CONFIG -= shared
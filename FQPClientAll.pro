@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# The library, its tests and its benchmarks. FQPClient.pro still builds
+# just the library.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    lib \
+    tests \
+    bench \
+
+lib.file = FQPClient.pro
+tests.subdir = tests
+tests.depends = lib
+bench.subdir = bench
+bench.depends = lib
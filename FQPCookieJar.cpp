@@ -0,0 +1,122 @@
+#include "FQPCookieJar.h"
+
+#include "FQPCookieStore.h"
+
+#include <QDateTime>
+#include <QNetworkCookie>
+
+// The cookies worth keeping between runs.
+static QList<QNetworkCookie>
+_PersistentCookies(const QList<QNetworkCookie>& cookies)
+{
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<QNetworkCookie> persistent;
+    foreach (const QNetworkCookie& cookie, cookies) {
+        if (!cookie.isSessionCookie() && (cookie.expirationDate() > now)) {
+            persistent.append(cookie);
+        }
+    }
+    return persistent;
+}
+
+// Whether saving cookie over saved would change anything worth writing. Servers
+// (Django's csrftoken, say) send the same cookie again on every response, with
+// the expiry pushed back a little, so an expiry that's off by less than a tenth
+// of what's left of it doesn't count.
+static bool
+_IsSameForSaving(const QNetworkCookie& cookie, const QNetworkCookie& saved,
+                 const QDateTime& now)
+{
+    if (!cookie.hasSameIdentifier(saved) || (cookie.value() != saved.value()) ||
+        (cookie.isSecure() != saved.isSecure()) ||
+        (cookie.isHttpOnly() != saved.isHttpOnly())) {
+        return false;
+    }
+    qint64 remaining = now.secsTo(cookie.expirationDate());
+    qint64 drift = qAbs(saved.expirationDate().secsTo(cookie.expirationDate()));
+    return drift <= remaining / 10;
+}
+
+FQPCookieJar::FQPCookieJar(const FQPCookieStoreSharedPtr& store,
+                           QObject *parent) :
+    QNetworkCookieJar(parent),
+    _store(store)
+{
+    if (!_store) {
+        return;
+    }
+    _savedCookies = _PersistentCookies(_store->Load());
+    setAllCookies(_savedCookies);
+}
+
+FQPCookieJar::~FQPCookieJar()
+{
+}
+
+QByteArray
+FQPCookieJar::GetCookieValue(const QByteArray& name, const QUrl& url) const
+{
+    foreach (const QNetworkCookie& cookie, cookiesForUrl(url)) {
+        if (cookie.name() == name) {
+            return cookie.value();
+        }
+    }
+    return QByteArray();
+}
+
+bool
+FQPCookieJar::setCookiesFromUrl(const QList<QNetworkCookie>& cookieList,
+                                const QUrl& url)
+{
+    bool changed = QNetworkCookieJar::setCookiesFromUrl(cookieList, url);
+    if (changed) {
+        _Save();
+    }
+    return changed;
+}
+
+bool
+FQPCookieJar::deleteCookie(const QNetworkCookie& cookie)
+{
+    bool deleted = QNetworkCookieJar::deleteCookie(cookie);
+    if (deleted) {
+        _Save();
+    }
+    return deleted;
+}
+
+void
+FQPCookieJar::_Save()
+{
+    if (!_store) {
+        return;
+    }
+    QList<QNetworkCookie> persistent = _PersistentCookies(allCookies());
+    if (!_HasChanged(persistent)) {
+        return;
+    }
+    _store->Save(persistent);
+    _savedCookies = persistent;
+}
+
+bool
+FQPCookieJar::_HasChanged(const QList<QNetworkCookie>& persistent) const
+{
+    if (persistent.size() != _savedCookies.size()) {
+        return true;
+    }
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    foreach (const QNetworkCookie& cookie, persistent) {
+        bool found = false;
+        foreach (const QNetworkCookie& saved, _savedCookies) {
+            if (cookie.hasSameIdentifier(saved)) {
+                found = _IsSameForSaving(cookie, saved, now);
+                break;
+            }
+        }
+        if (!found) {
+            return true;
+        }
+    }
+    return false;
+}
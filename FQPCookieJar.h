@@ -0,0 +1,44 @@
+#ifndef FQPCOOKIEJAR_H
+#define FQPCOOKIEJAR_H
+
+#include "FQPTypes.h"
+
+#include <QList>
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+
+FQP_DECLARE_PTRS(FQPCookieStore)
+
+// Cookie jar that starts out with the cookies in the store, and writes the
+// persistent ones back to it when the server changes them. Session cookies and
+// expired cookies are never saved. The server sending a cookie we already have
+// again (with about the same expiry) isn't a change, so it doesn't cost a
+// write.
+class FQPCookieJar : public QNetworkCookieJar
+{
+    Q_OBJECT
+
+public:
+    explicit FQPCookieJar(const FQPCookieStoreSharedPtr& store,
+                          QObject *parent = 0);
+
+    virtual ~FQPCookieJar();
+
+    // The value of the named cookie that we'd send to url, or empty.
+    QByteArray GetCookieValue(const QByteArray& name, const QUrl& url) const;
+
+    virtual bool setCookiesFromUrl(const QList<QNetworkCookie>& cookieList,
+                                   const QUrl& url) override;
+    virtual bool deleteCookie(const QNetworkCookie& cookie) override;
+
+protected:
+    void _Save();
+    // Whether persistent differs from what we last saved.
+    bool _HasChanged(const QList<QNetworkCookie>& persistent) const;
+
+private:
+    FQPCookieStoreSharedPtr _store;
+    QList<QNetworkCookie> _savedCookies;
+};
+
+#endif // FQPCOOKIEJAR_H
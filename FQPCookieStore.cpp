@@ -0,0 +1,45 @@
+#include "FQPCookieStore.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+FQPFileCookieStore::FQPFileCookieStore(const QString& path) :
+    _path(path)
+{
+}
+
+QList<QNetworkCookie>
+FQPFileCookieStore::Load()
+{
+    QList<QNetworkCookie> cookies;
+    QFile file(_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Nothing saved yet.
+        return cookies;
+    }
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (!line.isEmpty()) {
+            cookies.append(QNetworkCookie::parseCookies(line));
+        }
+    }
+    return cookies;
+}
+
+void
+FQPFileCookieStore::Save(const QList<QNetworkCookie>& cookies)
+{
+    QSaveFile file(_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "FQPFileCookieStore: unable to save: " << file.errorString();
+        return;
+    }
+    foreach (const QNetworkCookie& cookie, cookies) {
+        file.write(cookie.toRawForm(QNetworkCookie::Full));
+        file.write("\n");
+    }
+    if (!file.commit()) {
+        qDebug() << "FQPFileCookieStore: unable to save: " << file.errorString();
+    }
+}
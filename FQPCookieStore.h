@@ -0,0 +1,35 @@
+#ifndef FQPCOOKIESTORE_H
+#define FQPCOOKIESTORE_H
+
+#include "FQPTypes.h"
+
+#include <QList>
+#include <QNetworkCookie>
+#include <QString>
+
+// Where FQPCookieJar keeps its cookies between runs. Implement this to keep
+// them somewhere other than a file (the keychain, app settings, ...).
+class FQPCookieStore
+{
+public:
+    virtual ~FQPCookieStore() {}
+
+    virtual QList<QNetworkCookie> Load() = 0;
+    // Called with all of the jar's persistent cookies whenever they change.
+    virtual void Save(const QList<QNetworkCookie>& cookies) = 0;
+};
+
+// Keeps the cookies in a file, one Set-Cookie line per cookie.
+class FQPFileCookieStore : public FQPCookieStore
+{
+public:
+    explicit FQPFileCookieStore(const QString& path);
+
+    virtual QList<QNetworkCookie> Load() override;
+    virtual void Save(const QList<QNetworkCookie>& cookies) override;
+
+private:
+    QString _path;
+};
+
+#endif // FQPCOOKIESTORE_H
@@ -0,0 +1,151 @@
+#ifndef FQPFUTURE_H
+#define FQPFUTURE_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QList>
+#include <QVector>
+
+#include <memory>
+
+// Combinators for the futures returned by the FQPClient::*Async calls. A
+// failed request cancels its future (QFuture::isCanceled()), so these treat
+// cancellation as failure.
+//
+// The watchers we use live in the calling thread, so that thread needs an
+// event loop.
+
+template <typename T>
+struct FQPWhenAllState {
+    QFutureInterface<QList<T> > output;
+    QVector<T> results;
+    int remaining;
+    bool canceled;
+};
+
+// Finishes with all of the results, in the order of futures, once all of them
+// have finished. Canceled if any of them was.
+template <typename T>
+QFuture<QList<T> > FQPWhenAll(const QList<QFuture<T> >& futures)
+{
+    std::shared_ptr<FQPWhenAllState<T> > state(new FQPWhenAllState<T>());
+    state->results.resize(futures.size());
+    state->remaining = futures.size();
+    state->canceled = false;
+    state->output.reportStarted();
+    if (futures.isEmpty()) {
+        state->output.reportResult(QList<T>());
+        state->output.reportFinished();
+        return state->output.future();
+    }
+
+    for (int i = 0 ; i < futures.size() ; ++i) {
+        QFutureWatcher<T>* watcher = new QFutureWatcher<T>();
+        QObject::connect(watcher, &QFutureWatcher<T>::finished,
+                         [state, watcher, i]() {
+                             if (watcher->isCanceled()) {
+                                 state->canceled = true;
+                             } else {
+                                 state->results[i] = watcher->result();
+                             }
+                             watcher->deleteLater();
+                             if (--state->remaining > 0) {
+                                 return;
+                             }
+                             if (state->canceled) {
+                                 state->output.reportCanceled();
+                             } else {
+                                 state->output.reportResult(
+                                     state->results.toList());
+                             }
+                             state->output.reportFinished();
+                         });
+        watcher->setFuture(futures[i]);
+    }
+    return state->output.future();
+}
+
+inline QFuture<void> FQPWhenAll(const QList<QFuture<void> >& futures)
+{
+    struct State {
+        QFutureInterface<void> output;
+        int remaining;
+        bool canceled;
+    };
+    std::shared_ptr<State> state(new State());
+    state->remaining = futures.size();
+    state->canceled = false;
+    state->output.reportStarted();
+    if (futures.isEmpty()) {
+        state->output.reportFinished();
+        return state->output.future();
+    }
+
+    foreach (const QFuture<void>& future, futures) {
+        QFutureWatcher<void>* watcher = new QFutureWatcher<void>();
+        QObject::connect(watcher, &QFutureWatcher<void>::finished,
+                         [state, watcher]() {
+                             if (watcher->isCanceled()) {
+                                 state->canceled = true;
+                             }
+                             watcher->deleteLater();
+                             if (--state->remaining > 0) {
+                                 return;
+                             }
+                             if (state->canceled) {
+                                 state->output.reportCanceled();
+                             }
+                             state->output.reportFinished();
+                         });
+        watcher->setFuture(future);
+    }
+    return state->output.future();
+}
+
+template <typename T>
+struct FQPWhenAnyState {
+    QFutureInterface<T> output;
+    int remaining;
+    bool done;
+};
+
+// Finishes with the result of the first future to finish without being
+// canceled. Canceled only if all of them were.
+template <typename T>
+QFuture<T> FQPWhenAny(const QList<QFuture<T> >& futures)
+{
+    std::shared_ptr<FQPWhenAnyState<T> > state(new FQPWhenAnyState<T>());
+    state->remaining = futures.size();
+    state->done = false;
+    state->output.reportStarted();
+    if (futures.isEmpty()) {
+        state->output.reportCanceled();
+        state->output.reportFinished();
+        return state->output.future();
+    }
+
+    foreach (const QFuture<T>& future, futures) {
+        QFutureWatcher<T>* watcher = new QFutureWatcher<T>();
+        QObject::connect(watcher, &QFutureWatcher<T>::finished,
+                         [state, watcher]() {
+                             watcher->deleteLater();
+                             --state->remaining;
+                             if (state->done) {
+                                 return;
+                             }
+                             if (!watcher->isCanceled()) {
+                                 state->done = true;
+                                 state->output.reportResult(watcher->result());
+                                 state->output.reportFinished();
+                             } else if (state->remaining == 0) {
+                                 state->output.reportCanceled();
+                                 state->output.reportFinished();
+                             }
+                         });
+        watcher->setFuture(future);
+    }
+    return state->output.future();
+}
+
+#endif // FQPFUTURE_H
@@ -0,0 +1,249 @@
+#include "FQPJsonPatch.h"
+
+#include <QDebug>
+#include <QJsonObject>
+#include <QStringList>
+
+enum _EditMode {
+    _AddMode,
+    _ReplaceMode,
+    _RemoveMode,
+};
+
+// Splits an RFC 6901 JSON Pointer into its reference tokens. The empty
+// pointer is the whole document.
+static bool
+_ParsePointer(const QString& pointer, QStringList& tokens)
+{
+    tokens.clear();
+    if (pointer.isEmpty()) {
+        return true;
+    }
+    if (!pointer.startsWith('/')) {
+        return false;
+    }
+    foreach (QString token, pointer.mid(1).split('/')) {
+        token.replace("~1", "/");
+        token.replace("~0", "~");
+        tokens.append(token);
+    }
+    return true;
+}
+
+// The array index token refers to, or -1. Only an add can refer to the end
+// of the array (by index, or "-").
+static int
+_ArrayIndex(const QString& token, int size, bool forAdd)
+{
+    if (forAdd && (token == "-")) {
+        return size;
+    }
+    // Only "0", or digits without a leading zero. (toInt() would also take a
+    // sign, or spaces.)
+    if (token.isEmpty() || ((token.size() > 1) && token.startsWith('0'))) {
+        return -1;
+    }
+    foreach (QChar c, token) {
+        if ((c < '0') || (c > '9')) {
+            return -1;
+        }
+    }
+    bool ok = false;
+    int index = token.toInt(&ok);
+    if (!ok) {
+        return -1;
+    }
+    if ((index > size) || (!forAdd && (index == size))) {
+        return -1;
+    }
+    return index;
+}
+
+static bool
+_Get(const QJsonValue& root, const QStringList& tokens, QJsonValue& value)
+{
+    QJsonValue current = root;
+    foreach (const QString& token, tokens) {
+        if (current.isObject()) {
+            QJsonObject object = current.toObject();
+            if (!object.contains(token)) {
+                return false;
+            }
+            current = object.value(token);
+        } else if (current.isArray()) {
+            QJsonArray array = current.toArray();
+            int index = _ArrayIndex(token, array.size(), false);
+            if (index < 0) {
+                return false;
+            }
+            current = array.at(index);
+        } else {
+            return false;
+        }
+    }
+    value = current;
+    return true;
+}
+
+// Walks down the path to the last token's parent and edits it there, writing
+// each level back on the way up. Each level still shares its data with the
+// level above, so the write back copies it, and the root copies all of it.
+static bool
+_Edit(QJsonValue& node, const QStringList& tokens, int depth,
+      _EditMode mode, const QJsonValue& value)
+{
+    const QString& token = tokens[depth];
+    bool last = (depth == tokens.size() - 1);
+
+    if (node.isObject()) {
+        QJsonObject object = node.toObject();
+        if (last) {
+            bool exists = object.contains(token);
+            if (mode == _RemoveMode) {
+                if (!exists) {
+                    return false;
+                }
+                object.remove(token);
+            } else {
+                if ((mode == _ReplaceMode) && !exists) {
+                    return false;
+                }
+                object.insert(token, value);
+            }
+        } else {
+            if (!object.contains(token)) {
+                return false;
+            }
+            QJsonValue child = object.value(token);
+            if (!_Edit(child, tokens, depth + 1, mode, value)) {
+                return false;
+            }
+            object.insert(token, child);
+        }
+        node = object;
+        return true;
+    }
+
+    if (node.isArray()) {
+        QJsonArray array = node.toArray();
+        int index = _ArrayIndex(token, array.size(),
+                                last && (mode == _AddMode));
+        if (index < 0) {
+            return false;
+        }
+        if (last) {
+            switch (mode) {
+            case _AddMode:
+                array.insert(index, value);
+                break;
+            case _ReplaceMode:
+                array.replace(index, value);
+                break;
+            case _RemoveMode:
+                array.removeAt(index);
+                break;
+            }
+        } else {
+            QJsonValue child = array.at(index);
+            if (!_Edit(child, tokens, depth + 1, mode, value)) {
+                return false;
+            }
+            array.replace(index, child);
+        }
+        node = array;
+        return true;
+    }
+
+    return false;
+}
+
+static bool
+_Add(QJsonValue& root, const QStringList& path, const QJsonValue& value)
+{
+    if (path.isEmpty()) {
+        root = value;
+        return true;
+    }
+    return _Edit(root, path, 0, _AddMode, value);
+}
+
+bool
+FQPJson_ApplyPatch(QJsonValue& target, const QJsonArray& operations)
+{
+    // Work on a copy (which is cheap until we change it), so a failed
+    // operation leaves target alone.
+    QJsonValue working = target;
+    foreach (const QJsonValue& operationValue, operations) {
+        QJsonObject operation = operationValue.toObject();
+        QString op = operation.value("op").toString();
+        QStringList path;
+        bool ok = _ParsePointer(operation.value("path").toString(), path);
+
+        if (!ok) {
+            // Bad path. Fall through to the failure.
+        } else if (op == "add") {
+            ok = operation.contains("value") &&
+                _Add(working, path, operation.value("value"));
+        } else if (op == "remove") {
+            ok = !path.isEmpty() &&
+                _Edit(working, path, 0, _RemoveMode, QJsonValue());
+        } else if (op == "replace") {
+            ok = operation.contains("value");
+            if (ok && path.isEmpty()) {
+                working = operation.value("value");
+            } else if (ok) {
+                ok = _Edit(working, path, 0, _ReplaceMode,
+                           operation.value("value"));
+            }
+        } else if ((op == "move") || (op == "copy")) {
+            QStringList from;
+            QJsonValue value;
+            ok = _ParsePointer(operation.value("from").toString(), from) &&
+                _Get(working, from, value);
+            if (ok && (op == "move")) {
+                // Can't move something into itself.
+                bool intoItself = (path.size() > from.size()) &&
+                    (path.mid(0, from.size()) == from);
+                ok = !from.isEmpty() && !intoItself &&
+                    _Edit(working, from, 0, _RemoveMode, QJsonValue());
+            }
+            ok = ok && _Add(working, path, value);
+        } else if (op == "test") {
+            QJsonValue value;
+            ok = _Get(working, path, value) &&
+                (value == operation.value("value"));
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            qDebug() << "FQPJson_ApplyPatch: unable to apply " << operation;
+            return false;
+        }
+    }
+    target = working;
+    return true;
+}
+
+void
+FQPJson_ApplyMergePatch(QJsonValue& target, const QJsonValue& patch)
+{
+    if (!patch.isObject()) {
+        target = patch;
+        return;
+    }
+    QJsonObject object = target.isObject() ? target.toObject() : QJsonObject();
+    QJsonObject patchObject = patch.toObject();
+    for (QJsonObject::const_iterator it = patchObject.constBegin() ;
+         it != patchObject.constEnd() ;
+         ++it) {
+        if (it.value().isNull()) {
+            object.remove(it.key());
+        } else {
+            QJsonValue child = object.value(it.key());
+            FQPJson_ApplyMergePatch(child, it.value());
+            object.insert(it.key(), child);
+        }
+    }
+    target = object;
+}
@@ -0,0 +1,20 @@
+#ifndef FQPJSONPATCH_H
+#define FQPJSONPATCH_H
+
+#include <QJsonArray>
+#include <QJsonValue>
+
+// Applies an RFC 6902 JSON Patch (an array of add/remove/replace/move/copy/test
+// operations) to target. Either every operation applies, or target is left as
+// it was and we return false.
+//
+// Qt keeps a JSON document as one binary blob, and a change anywhere in it
+// rewrites the blob, so each operation costs about one copy of target (but
+// no parsing).
+bool FQPJson_ApplyPatch(QJsonValue& target, const QJsonArray& operations);
+
+// Applies an RFC 7386 merge patch to target: objects are merged key by key,
+// nulls remove keys, and anything else replaces what was there.
+void FQPJson_ApplyMergePatch(QJsonValue& target, const QJsonValue& patch);
+
+#endif // FQPJSONPATCH_H
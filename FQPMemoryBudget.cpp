@@ -0,0 +1,118 @@
+#include "FQPMemoryBudget.h"
+
+#include <QMutexLocker>
+
+FQPMemoryBudget::FQPMemoryBudget(qint64 budgetBytes, qint64 maxResponseBytes,
+                                 QObject *parent) :
+    QObject(parent),
+    _budget(qMax<qint64>(0, budgetBytes)),
+    _maxResponseBytes(qMax<qint64>(0, maxResponseBytes)),
+    _inUse(0),
+    _pausedBytes(0),
+    _highWaterMark(0),
+    _pauseCount(0),
+    _starved(false)
+{
+}
+
+FQPMemoryBudget::~FQPMemoryBudget()
+{
+}
+
+qint64
+FQPMemoryBudget::GetBudget() const
+{
+    return _budget;
+}
+
+qint64
+FQPMemoryBudget::GetMaxResponseBytes() const
+{
+    return _maxResponseBytes;
+}
+
+qint64
+FQPMemoryBudget::GetInUse() const
+{
+    QMutexLocker locker(&_mutex);
+    return _inUse;
+}
+
+qint64
+FQPMemoryBudget::GetHighWaterMark() const
+{
+    QMutexLocker locker(&_mutex);
+    return _highWaterMark;
+}
+
+qint64
+FQPMemoryBudget::GetPauseCount() const
+{
+    QMutexLocker locker(&_mutex);
+    return _pauseCount;
+}
+
+qint64
+FQPMemoryBudget::Reserve(qint64 bytes, qint64 heldBytes)
+{
+    QMutexLocker locker(&_mutex);
+    qint64 granted = bytes;
+    if (_budget > 0) {
+        granted = qMin(bytes, qMax<qint64>(0, _budget - _inUse));
+        if ((granted == 0) && (_inUse - heldBytes == _pausedBytes)) {
+            // Everyone else holding memory is waiting for it, so no one is
+            // going to free any.
+            granted = bytes;
+        }
+    }
+    if (granted < bytes) {
+        // The caller stops reading until it gets the rest, so wake it on the
+        // next release.
+        _starved = true;
+    }
+    _inUse += granted;
+    _highWaterMark = qMax(_highWaterMark, _inUse);
+    return granted;
+}
+
+void
+FQPMemoryBudget::Release(qint64 bytes)
+{
+    if (bytes <= 0) {
+        return;
+    }
+    bool wake = false;
+    {
+        QMutexLocker locker(&_mutex);
+        _inUse -= bytes;
+        wake = _starved;
+        _starved = false;
+    }
+    if (wake) {
+        emit Released();
+    }
+}
+
+void
+FQPMemoryBudget::Pause(qint64 heldBytes)
+{
+    bool wake = false;
+    {
+        QMutexLocker locker(&_mutex);
+        _pausedBytes += heldBytes;
+        _pauseCount++;
+        // If we were the last one reading, wake the others so one of them can
+        // go over the budget.
+        wake = (_inUse == _pausedBytes);
+    }
+    if (wake) {
+        emit Released();
+    }
+}
+
+void
+FQPMemoryBudget::Resume(qint64 heldBytes)
+{
+    QMutexLocker locker(&_mutex);
+    _pausedBytes -= heldBytes;
+}
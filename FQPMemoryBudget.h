@@ -0,0 +1,60 @@
+#ifndef FQPMEMORYBUDGET_H
+#define FQPMEMORYBUDGET_H
+
+#include <QMutex>
+#include <QObject>
+
+// Accounts for the memory held by response buffers across all of a client's
+// requests. Reply handlers reserve bytes before reading them off the reply,
+// and release them once the results have been delivered. When the budget is
+// used up, handlers get less (or nothing) and stop reading, which leaves the
+// data in the socket, until Released tells them to try again.
+//
+// Handlers that stop reading say so with Pause(), so we can tell when every
+// handler holding memory is waiting for someone else to free some. Then no one
+// would, so we let one go over the budget rather than deadlock.
+class FQPMemoryBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 0 for either means no limit.
+    explicit FQPMemoryBudget(qint64 budgetBytes, qint64 maxResponseBytes,
+                             QObject *parent = 0);
+
+    virtual ~FQPMemoryBudget();
+
+    qint64 GetBudget() const;
+    qint64 GetMaxResponseBytes() const;
+    qint64 GetInUse() const;
+    // The most that has been in use at once.
+    qint64 GetHighWaterMark() const;
+    // How many times a handler had to stop reading.
+    qint64 GetPauseCount() const;
+
+    // Reserves up to bytes, and returns how many were reserved. heldBytes is
+    // what the caller already has reserved.
+    qint64 Reserve(qint64 bytes, qint64 heldBytes);
+    void Release(qint64 bytes);
+
+    // The caller, holding heldBytes, has stopped (or restarted) reading.
+    void Pause(qint64 heldBytes);
+    void Resume(qint64 heldBytes);
+
+signals:
+    // Memory was released while someone was waiting for it (any of it, since
+    // a partial grant waits too).
+    void Released();
+
+private:
+    mutable QMutex _mutex;
+    qint64 _budget;
+    qint64 _maxResponseBytes;
+    qint64 _inUse;
+    qint64 _pausedBytes;
+    qint64 _highWaterMark;
+    qint64 _pauseCount;
+    bool _starved;
+};
+
+#endif // FQPMEMORYBUDGET_H
@@ -1,12 +1,13 @@
 #include "FQPReplyHandler.h"
 
 #include "FQPClient.h"
+#include "FQPMemoryBudget.h"
 #include "FQPRequest.h"
+#include "FQPRequestJournal.h"
 
 #include <QAuthenticator>
 #include <QDebug>
 #include <QNetworkCookie>
-#include <QNetworkCookieJar>
 #include <QIODevice>
 #include <QThread>
 
@@ -21,7 +22,15 @@ FQPReplyHandler::FQPReplyHandler(QNetworkAccessManagerPtr accessManager,
     QObject(parent),
     _accessManager(accessManager),
     _request(request),
-    _completed(false)
+    _reply(NULL),
+    _completed(false),
+    _deferTransientFailures(false),
+    _deliverResponse(false),
+    _redirectCount(0),
+    _reservedBytes(0),
+    _readPaused(false),
+    _finishPending(false),
+    _tooLarge(false)
 {
     if (resultParameters) {
         if (resultParameters->size() > 0) {
@@ -37,30 +46,51 @@ FQPReplyHandler::FQPReplyHandler(QNetworkAccessManagerPtr accessManager,
 
 FQPReplyHandler::~FQPReplyHandler()
 {
+    _ReleaseBuffer();
     delete _reply;
 }
 
 void
 FQPReplyHandler::Request()
 {
-    // Store it because we may need to get the information for redirects, etc.
-    QNetworkAccessManagerSharedPtr accessManager = _accessManager.lock();
     FQPRequestSharedPtr request = _request.lock();
+    if (!request) {
+        return;
+    }
+    _redirectCount = 0;
+    _Send(request->GetRequest(), request->GetMethod(), request->GetContent());
+}
 
-    if (!accessManager || !request) {
+void
+FQPReplyHandler::_Send(const QNetworkRequest& networkRequest,
+                       const QByteArray& method,
+                       const QByteArray& content)
+{
+    QNetworkAccessManagerSharedPtr accessManager = _accessManager.lock();
+    if (!accessManager) {
         return;
     }
+    if (_reply) {
+        // We're sending this again (a redirect, or a replay from the
+        // journal), so we're done with the last reply.
+        _reply->disconnect(this);
+        _reply->deleteLater();
+        _reply = NULL;
+    }
+    _completed = false;
+    _finishPending = false;
+    _tooLarge = false;
     QObject::connect(accessManager.get(),
                      &QNetworkAccessManager::authenticationRequired,
                      this,
-                     &FQPReplyHandler::_OnAuthenticationRequired);
+                     &FQPReplyHandler::_OnAuthenticationRequired,
+                     Qt::UniqueConnection);
     QObject::connect(accessManager.get(),
                      &QNetworkAccessManager::finished,
                      this,
-                     &FQPReplyHandler::_OnAccessManagerFinished);
-    _reply = accessManager->sendCustomRequest(request->GetRequest(),
-                                              request->GetMethod(),
-                                              request->GetContent());
+                     &FQPReplyHandler::_OnAccessManagerFinished,
+                     Qt::UniqueConnection);
+    _reply = accessManager->sendCustomRequest(networkRequest, method, content);
     QObject::connect(_reply,
                      static_cast<void(QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),
                      this, &FQPReplyHandler::_OnError);
@@ -70,16 +100,61 @@ FQPReplyHandler::Request()
                      this, &FQPReplyHandler::_OnBytesReceived);
     QObject::connect(_reply, &QNetworkReply::sslErrors,
                      this, &FQPReplyHandler::_OnSslErrors);
+    if (_memoryBudget) {
+        // Don't let the reply buffer much more than we've asked for, so if we
+        // stop reading, the data waits in the socket.
+        _reply->setReadBufferSize(ReadBufferBytes);
+        QObject::connect(_reply, &QNetworkReply::metaDataChanged,
+                         this, &FQPReplyHandler::_OnMetaDataChanged);
+    }
 
     // QIODevice signals
     QObject::connect(_reply, &QNetworkReply::readyRead,
                      this, &FQPReplyHandler::_OnReadyRead);
     //    _reply->abort();
     //request->GetContent());
-    _buffer.clear();
+    _ReleaseBuffer();
     // QNetworkReply signals
 }
 
+void
+FQPReplyHandler::SetMemoryBudget(const FQPMemoryBudgetSharedPtr& memoryBudget)
+{
+    _memoryBudget = memoryBudget;
+}
+
+void
+FQPReplyHandler::SetDeferTransientFailures(bool defer)
+{
+    _deferTransientFailures = defer;
+}
+
+void
+FQPReplyHandler::SetDeliverResponse(bool deliver)
+{
+    _deliverResponse = deliver;
+}
+
+bool
+FQPReplyHandler::IsTransientError(QNetworkReply::NetworkError error)
+{
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyConnectionRefusedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::ServiceUnavailableError:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void
 FQPReplyHandler::_OnAuthenticationRequired(QNetworkReply * ,
                                            QAuthenticator * /*authenticator*/)
@@ -105,26 +180,113 @@ FQPReplyHandler::_OnAccessManagerFinished(QNetworkReply * reply)
 void
 FQPReplyHandler::_OnFinished()
 {
-    if (_reply->error() == QNetworkReply::ProtocolUnknownError) {
-        // Start a new request
-        QVariant locationHeader = _reply->header(QNetworkRequest::LocationHeader);
-        if (locationHeader.type() != QVariant::String) {
-            throw FQPNetworkException();
+    int status =
+        _reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QUrl location =
+        _reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (_IsRedirect(status) && location.isValid()) {
+        QUrl target = _reply->url().resolved(location);
+        QNetworkReply::NetworkError redirectError = QNetworkReply::NoError;
+        if (_redirectCount >= MaxRedirects) {
+            qDebug() << "FQPReplyHandler: too many redirects at "
+                     << _reply->url();
+            redirectError = QNetworkReply::TooManyRedirectsError;
+        } else if ((_reply->url().scheme() == "https") &&
+                   (target.scheme() != "https")) {
+            qDebug() << "FQPReplyHandler: refusing to redirect from "
+                     << _reply->url() << " to " << target;
+            redirectError = QNetworkReply::InsecureRedirectError;
+        }
+        if (redirectError != QNetworkReply::NoError) {
+            _ReleaseBuffer();
+            _EmitResults(redirectError);
+            _completed = true;
+            return;
         }
-        QString locationString = locationHeader.toString();
-        Request();
+        // Redirects can set cookies too.
+        _StoreCSRF();
+        _FollowRedirect(status, target);
+        return;
+    } else if (_deferTransientFailures &&
+               IsTransientError(_reply->error())) {
+        // The client will send us again, so don't report anything yet.
+        emit TransientFailureDeferred(_reply->error());
+        return;
     } else {
-        auto request = _request.lock();
-        if (request) {
-            _StoreCSRF(request->GetRequest().url());
-            // Read the rest of the buffer, if there's anything left
+        // Read the rest of the buffer, if there's anything left
+        _ReadAvailable();
+        if (_tooLarge) {
+            return;
         }
-        _buffer.append(_reply->readAll());
-        _EmitResults();
+        if (_readPaused) {
+            // We'll finish once there's memory for the rest.
+            _finishPending = true;
+            return;
+        }
+        _StoreCSRF();
+        _EmitResults(_reply->error());
+        // Whoever wanted the results has them.
+        _ReleaseBuffer();
     }
     _completed = true;
 }
 
+bool
+FQPReplyHandler::IsSameOrigin(const QUrl& a, const QUrl& b)
+{
+    int defaultPortA = (a.scheme() == "https") ? 443 : 80;
+    int defaultPortB = (b.scheme() == "https") ? 443 : 80;
+    return (a.scheme() == b.scheme()) &&
+        (a.host().compare(b.host(), Qt::CaseInsensitive) == 0) &&
+        (a.port(defaultPortA) == b.port(defaultPortB));
+}
+
+bool
+FQPReplyHandler::_IsRedirect(int status)
+{
+    return (status == 301) || (status == 302) || (status == 303) ||
+        (status == 307) || (status == 308);
+}
+
+void
+FQPReplyHandler::_FollowRedirect(int status, const QUrl& target)
+{
+    FQPRequestSharedPtr request = _request.lock();
+    if (!request) {
+        return;
+    }
+    _redirectCount++;
+    if (((status == 301) || (status == 308)) &&
+        IsSameOrigin(_reply->url(), target)) {
+        // Let the client send the next request straight to the target. Not
+        // for other origins, which would then get all of our later requests.
+        emit PermanentRedirectReceived(_reply->url(), target);
+    }
+
+    QNetworkRequest networkRequest = request->GetRequest();
+    if (!IsSameOrigin(networkRequest.url(), target)) {
+        // The token and the key are only for the server we meant to send
+        // them to.
+        networkRequest.setRawHeader(FQPClient::CSRFHeaderName, QByteArray());
+        networkRequest.setRawHeader(FQPRequestJournal::IdempotencyHeaderName,
+                                    QByteArray());
+    }
+    networkRequest.setUrl(target);
+    QByteArray method = request->GetMethod();
+    QByteArray content = request->GetContent();
+    // 307 and 308 mean "send the same thing there". For the others, anything
+    // with a body becomes a GET without one, which is what servers expect.
+    if ((status != 307) && (status != 308)) {
+        QByteArray upperMethod = method.toUpper();
+        if ((upperMethod != "GET") && (upperMethod != "HEAD")) {
+            method = "GET";
+            content.clear();
+        }
+    }
+    qDebug() << "FQPReplyHandler: " << status << " redirect to " << target;
+    _Send(networkRequest, method, content);
+}
+
 void
 FQPReplyHandler::_OnBytesReceived(qint64 bytesReceived, qint64 /*bytesTotal*/)
 {
@@ -133,18 +295,7 @@ FQPReplyHandler::_OnBytesReceived(qint64 bytesReceived, qint64 /*bytesTotal*/)
         qDebug() << "Nothing to read";
         return;
     }
-    QByteArray bytesRead = _reply->readAll();
-    if (bytesRead.size() == 0) {
-        //qDebug() << "-1 returned from QIODevice::read()";
-        //qDebug() << "0 bytes read from QIODevice::readAll()";
-        return;
-    } else if (bytesRead.size() != bytesReceived) {
-        // This was garbage (on android, at least), so throw it out.
-        qDebug() << "Read " << bytesRead << ", expected " << bytesReceived;
-        //                 << "[" << buffer << "]";
-    }
-    _buffer.append(bytesRead);
-
+    _ReadAvailable();
 }    
 
 void
@@ -155,7 +306,36 @@ FQPReplyHandler::_OnReadyRead()
     // single requests (not the check, then fetch), so we assume that the caller
     // wants to get this request and there isn't a fetch coming.
     //qDebug() << "ReadyRead content: " << _buffer;
-    _buffer.append(_reply->readAll());
+    _ReadAvailable();
+}
+
+void
+FQPReplyHandler::_OnMetaDataChanged()
+{
+    // Fail before reading anything if the server tells us it's too big.
+    QVariant contentLength = _reply->header(QNetworkRequest::ContentLengthHeader);
+    qint64 maxBytes = _memoryBudget->GetMaxResponseBytes();
+    if (contentLength.isValid() && (maxBytes > 0) &&
+        (contentLength.toLongLong() > maxBytes)) {
+        _FailTooLarge(contentLength.toLongLong());
+    }
+}
+
+void
+FQPReplyHandler::_OnMemoryReleased()
+{
+    if (!_readPaused) {
+        return;
+    }
+    _readPaused = false;
+    QObject::disconnect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                        this, &FQPReplyHandler::_OnMemoryReleased);
+    _memoryBudget->Resume(_reservedBytes);
+    _ReadAvailable();
+    if (!_readPaused && _finishPending) {
+        _finishPending = false;
+        _OnFinished();
+    }
 }
 
 void
@@ -176,22 +356,99 @@ FQPReplyHandler::_OnSslErrors(const QList<QSslError>& errors)
 }
 
 void
-FQPReplyHandler::_StoreCSRF(const QUrl& baseUrl)
+FQPReplyHandler::_StoreCSRF()
 {
-    QNetworkCookie cookie;
-    auto accessManager = _accessManager.lock();
-    if (accessManager) {
-        foreach(cookie, accessManager->cookieJar()->cookiesForUrl(baseUrl)) {
-            if (cookie.name() == FQPClient::CSRFCookieName) {
-                // Actully, it seems like the manager holds on to this, so as
-                // long as the access manager doesn't go away, no one needs to
-                // listen to this notice.
-                emit CSRFTokenUpdated(cookie.value());
-            }
+    // Most replies don't set any cookies, so only look when the server sent
+    // some. The access manager has already parsed them (and put them in the
+    // jar), so we just pick the token out of this reply's.
+    if (!_reply->hasRawHeader("Set-Cookie")) {
+        return;
+    }
+    QList<QNetworkCookie> cookies = qvariant_cast<QList<QNetworkCookie> >(
+        _reply->header(QNetworkRequest::SetCookieHeader));
+    // The token we sent is the one the client had when it built the request.
+    // It may have changed since, so the client checks against its current
+    // one too.
+    QByteArray sentToken;
+    auto request = _request.lock();
+    if (request) {
+        sentToken = request->GetRequest().rawHeader(FQPClient::CSRFHeaderName);
+    }
+    foreach (const QNetworkCookie& cookie, cookies) {
+        if ((cookie.name() == FQPClient::CSRFCookieName) &&
+            (cookie.value() != sentToken)) {
+            emit CSRFTokenUpdated(cookie.value());
         }
     }
 }
 
+void
+FQPReplyHandler::_ReadAvailable()
+{
+    if (!_reply || _readPaused || _tooLarge) {
+        return;
+    }
+    qint64 available = _reply->bytesAvailable();
+    if (available <= 0) {
+        return;
+    }
+    if (!_memoryBudget) {
+        _buffer.append(_reply->readAll());
+        return;
+    }
+
+    qint64 maxBytes = _memoryBudget->GetMaxResponseBytes();
+    if ((maxBytes > 0) && (_buffer.size() + available > maxBytes)) {
+        // No (or a wrong) Content-Length, so we only find out now.
+        _FailTooLarge(_buffer.size() + available);
+        return;
+    }
+    qint64 reserved = _memoryBudget->Reserve(available, _reservedBytes);
+    if (reserved > 0) {
+        _reservedBytes += reserved;
+        _buffer.append(_reply->read(reserved));
+    }
+    if (reserved < available) {
+        _readPaused = true;
+        QObject::connect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                         this, &FQPReplyHandler::_OnMemoryReleased,
+                         Qt::UniqueConnection);
+        _memoryBudget->Pause(_reservedBytes);
+    }
+}
+
+void
+FQPReplyHandler::_ReleaseBuffer()
+{
+    if (_memoryBudget) {
+        if (_readPaused) {
+            _readPaused = false;
+            QObject::disconnect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                                this, &FQPReplyHandler::_OnMemoryReleased);
+            _memoryBudget->Resume(_reservedBytes);
+        }
+        _memoryBudget->Release(_reservedBytes);
+    }
+    _reservedBytes = 0;
+    _buffer.clear();
+}
+
+void
+FQPReplyHandler::_FailTooLarge(qint64 size)
+{
+    qint64 maxBytes = _memoryBudget->GetMaxResponseBytes();
+    qDebug() << "FQPReplyHandler: response of " << size
+             << " bytes is over the limit of " << maxBytes;
+    _tooLarge = true;
+    _finishPending = false;
+    _reply->disconnect(this);
+    _reply->abort();
+    _ReleaseBuffer();
+    emit ResponseTooLarge(size, maxBytes);
+    _EmitResults(QNetworkReply::UnknownContentError);
+    _completed = true;
+}
+
 QJsonDocument
 FQPReplyHandler::_GetJsonFromContent(const QByteArray& content) const
 {
@@ -202,7 +459,8 @@ FQPReplyHandler::_GetJsonFromContent(const QByteArray& content) const
     QByteArray cleanedContent = content;
     unsigned int desiredSize = cleanedContent.size() -1;
     //qDebug() << "Raw: <<" << _buffer.data() << ">>";
-    while ((cleanedContent.at(desiredSize) != '}') &&
+    while ((cleanedContent.size() > 0) &&
+           (cleanedContent.at(desiredSize) != '}') &&
            (cleanedContent.at(desiredSize) != ']')) {
         // Remove crap at the end. Namely, the ';' that the server sticks on.
         // That's never valid JSON, so F-U rabbitmq management plugin.
@@ -214,23 +472,45 @@ FQPReplyHandler::_GetJsonFromContent(const QByteArray& content) const
 }
 
 void
-FQPReplyHandler::_EmitResults() {
+FQPReplyHandler::_EmitResults(QNetworkReply::NetworkError error) {
+    if (_deliverResponse) {
+        emit Completed(error);
+        emit ResponseReceived(
+            error,
+            _reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(),
+            _reply->rawHeader("ETag"),
+            _reply->rawHeader("Content-Type"),
+            _buffer);
+        return;
+    }
     QJsonDocument jsonDoc = _GetJsonFromContent(_buffer);
+    if ((_resultsFormat == InterpretedResults) &&
+        (error == QNetworkReply::NoError) && !jsonDoc.isObject()) {
+        // It worked, but there's nothing to take the results from (a 204, or
+        // a list, say). We're in a slot, so throwing would only unwind the
+        // event loop, and the handler would never be called.
+        qDebug() << "FQPReplyHandler: expected an object from "
+                 << _reply->url();
+        error = QNetworkReply::UnknownContentError;
+    }
+    // Sent with the same error as the results, so whoever's listening to both
+    // agrees.
+    emit Completed(error);
     // Does the client care about the data we get back?
     switch (_resultsFormat) {
     case NoResults:
-        emit InterpretedReplyReceived(_reply->error(),
+        emit InterpretedReplyReceived(error,
                                       QVariantList());
         break;
     case RawResults:
-        emit RawReplyReceived(_reply->error(), jsonDoc);
+        emit RawReplyReceived(error, jsonDoc);
         break;
     case InterpretedResults:
-        if (jsonDoc.isNull() || jsonDoc.isEmpty()) {
-            throw FQPNetworkException();
-        }
         if (!jsonDoc.isObject()) {
-            throw FQPNetworkException();
+            // Nothing to interpret. The handlers check for this, and the
+            // futures are canceled.
+            emit InterpretedReplyReceived(error, QVariantList());
+            break;
         }
         QVariantMap jsonObj = jsonDoc.object().toVariantMap();
         QVariantList vals;
@@ -240,6 +520,6 @@ FQPReplyHandler::_EmitResults() {
              ++paramIterator) {
             vals.append(jsonObj[*paramIterator]);
         }
-        emit InterpretedReplyReceived(_reply->error(), vals);
+        emit InterpretedReplyReceived(error, vals);
     }
 }
@@ -9,6 +9,7 @@
 
 FQP_DECLARE_PTRS(QNetworkAccessManager);
 FQP_DECLARE_PTRS(FQPRequest);
+FQP_DECLARE_PTRS(FQPMemoryBudget);
 
 // Class to hold the closure to be called when the reply is receieved. This
 // class doesn't actually call it. Rather, we pass ourselves back to the
@@ -22,6 +23,12 @@ class FQPReplyHandler : public QObject
 {
     Q_OBJECT
 public:
+    // Redirects we follow for one request before giving up with
+    // TooManyRedirectsError.
+    static const int MaxRedirects = 5;
+    // How much the reply buffers for us when we have a memory budget.
+    static const qint64 ReadBufferBytes = 64 * 1024;
+
     // Takes a list of result parameters to pull out of 
     explicit FQPReplyHandler(QNetworkAccessManagerPtr accessManager,
                              FQPRequestPtr request,
@@ -32,6 +39,26 @@ public:
 
     Q_INVOKABLE void Request();
 
+    // When set, a transient failure (we lost the connection, the host is
+    // unreachable, the server is temporarily unavailable, ...) doesn't emit
+    // the results. We emit TransientFailureDeferred instead, so the client can
+    // journal the request and call Request() again later.
+    void SetDeferTransientFailures(bool defer);
+
+    // Reserve the response buffer from memoryBudget, stop reading while it's
+    // used up, and fail responses that are over its maximum size.
+    void SetMemoryBudget(const FQPMemoryBudgetSharedPtr& memoryBudget);
+
+    // When set, we don't interpret the body at all. We emit ResponseReceived
+    // with it, and the headers needed to make sense of it, instead of the
+    // other results.
+    void SetDeliverResponse(bool deliver);
+
+    static bool IsTransientError(QNetworkReply::NetworkError error);
+
+    // Same scheme, host and port.
+    static bool IsSameOrigin(const QUrl& a, const QUrl& b);
+
 signals:
     void CSRFTokenUpdated(const QByteArray& token);    
     // One of these will be sent upon completion.
@@ -39,6 +66,21 @@ signals:
                                   const QVariantList& parameters);
     void RawReplyReceived(QNetworkReply::NetworkError error,
                           const QJsonDocument& data);
+    // Sent when the reply is finished (and not deferred), just before the
+    // results, whichever format they are in.
+    void Completed(QNetworkReply::NetworkError error);
+    void TransientFailureDeferred(QNetworkReply::NetworkError error);
+    // Sent for each same-origin 301 or 308 we follow.
+    void PermanentRedirectReceived(const QUrl& from, const QUrl& to);
+    // The response was over the memory budget's maximum response size, so we
+    // gave up on it. Sent just before the results, with UnknownContentError.
+    void ResponseTooLarge(qint64 size, qint64 limit);
+    // Sent instead of the results, when we're delivering the response.
+    void ResponseReceived(QNetworkReply::NetworkError error,
+                          int status,
+                          const QByteArray& etag,
+                          const QByteArray& contentType,
+                          const QByteArray& body);
 
 protected:
     enum ResultsFormat {
@@ -47,9 +89,27 @@ protected:
         InterpretedResults,
     };
         
-    void _StoreCSRF(const QUrl& baseUrl);
+    void _Send(const QNetworkRequest& networkRequest,
+               const QByteArray& method,
+               const QByteArray& content);
+    static bool _IsRedirect(int status);
+    // Sends the request again, to target. The CSRF token and idempotency key
+    // only go along if target has the same origin as the request. We refuse
+    // https to http before we get here, with InsecureRedirectError.
+    void _FollowRedirect(int status, const QUrl& target);
+
+    // Moves what the reply has into the buffer, as far as the budget allows.
+    void _ReadAvailable();
+    // Empties the buffer and gives its memory back to the budget.
+    void _ReleaseBuffer();
+    void _FailTooLarge(qint64 size);
+
+    void _StoreCSRF();
     QJsonDocument _GetJsonFromContent(const QByteArray& content) const;
-    void _EmitResults();
+    // Emits Completed and then the results. A reply that worked, but has no
+    // object to take the result parameters from, fails with
+    // UnknownContentError.
+    void _EmitResults(QNetworkReply::NetworkError error);
 
 protected slots:
     virtual void _OnAuthenticationRequired(QNetworkReply * reply,
@@ -58,6 +118,8 @@ protected slots:
     virtual void _OnFinished();
     virtual void _OnBytesReceived(qint64 bytesReceived, qint64 bytesTotal);
     virtual void _OnReadyRead();
+    virtual void _OnMetaDataChanged();
+    virtual void _OnMemoryReleased();
     virtual void _OnError(QNetworkReply::NetworkError error);
 
     // Handling SSL errors (Since android gives an error that iOS does not)
@@ -73,6 +135,16 @@ private:
     QByteArray _buffer;
     qint64 _bufferSize;
     bool _completed;
+    bool _deferTransientFailures;
+    bool _deliverResponse;
+    int _redirectCount;
+
+    FQPMemoryBudgetSharedPtr _memoryBudget;
+    qint64 _reservedBytes;
+    bool _readPaused;
+    // The reply finished while we were paused.
+    bool _finishPending;
+    bool _tooLarge;
 };
 
 #endif // FQPREPLYHANDLER_H
@@ -1,6 +1,7 @@
 #include "FQPRequest.h"
 
 #include "FQPClient.h"
+#include "FQPRequestJournal.h"
 
 #include <QJsonDocument>
 #include <QHttpMultiPart>
@@ -48,3 +49,28 @@ FQPRequest::GetContent() const
 {
     return _content;
 }
+
+bool
+FQPRequest::IsMutating() const
+{
+    QByteArray method = _method.toUpper();
+    return (method != "GET") && (method != "HEAD") && (method != "OPTIONS");
+}
+
+QByteArray
+FQPRequest::GetIdempotencyKey() const
+{
+    return _request.rawHeader(FQPRequestJournal::IdempotencyHeaderName);
+}
+
+void
+FQPRequest::SetIdempotencyKey(const QByteArray& key)
+{
+    _request.setRawHeader(FQPRequestJournal::IdempotencyHeaderName, key);
+}
+
+void
+FQPRequest::SetRawHeader(const QByteArray& name, const QByteArray& value)
+{
+    _request.setRawHeader(name, value);
+}
@@ -25,6 +25,15 @@ public:
     QByteArray GetMethod() const;
     QByteArray GetContent() const;
 
+    // Mutating requests (anything but GET, HEAD and OPTIONS) are the ones we
+    // journal when they can't be sent.
+    bool IsMutating() const;
+
+    QByteArray GetIdempotencyKey() const;
+    void SetIdempotencyKey(const QByteArray& key);
+
+    void SetRawHeader(const QByteArray& name, const QByteArray& value);
+
 private:
     QNetworkRequest _request;
     QByteArray _method;
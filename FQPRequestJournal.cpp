@@ -0,0 +1,256 @@
+#include "FQPRequestJournal.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QUuid>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+const QByteArray FQPRequestJournal::IdempotencyHeaderName = "Idempotency-Key";
+
+static const int DefaultSyncBatchSize = 32;
+static const int DefaultSyncIntervalMs = 200;
+static const int DefaultCompactionThreshold = 256;
+
+static QJsonObject _AddRecord(const FQPRequestJournal::Entry& entry)
+{
+    QJsonObject record;
+    record["op"] = QStringLiteral("add");
+    record["key"] = QString::fromLatin1(entry.key);
+    record["url"] = entry.url.toString();
+    record["method"] = QString::fromLatin1(entry.method);
+    record["content"] = QString::fromUtf8(entry.content);
+    return record;
+}
+
+FQPRequestJournal::FQPRequestJournal(const QString& path, QObject *parent) :
+    QObject(parent),
+    _file(path),
+    _unsyncedRecords(0),
+    _doneRecords(0),
+    _batchSize(DefaultSyncBatchSize),
+    _compactionThreshold(DefaultCompactionThreshold),
+    _tornTail(false)
+{
+    _syncTimer.setSingleShot(true);
+    _syncTimer.setInterval(DefaultSyncIntervalMs);
+    connect(&_syncTimer, &QTimer::timeout, this, &FQPRequestJournal::Sync);
+
+    _Load();
+    if (!_OpenForAppend()) {
+        throw FQPException("Unable to open request journal: " +
+                           _file.errorString());
+    }
+    if (_tornTail) {
+        // Otherwise the next record would be lost along with the torn one.
+        _file.write("\n");
+    }
+}
+
+FQPRequestJournal::~FQPRequestJournal()
+{
+    Sync();
+}
+
+QByteArray
+FQPRequestJournal::NewKey()
+{
+    // Strip the braces.
+    return QUuid::createUuid().toByteArray().mid(1, 36);
+}
+
+bool
+FQPRequestJournal::IsEmpty() const
+{
+    QMutexLocker locker(&_mutex);
+    return _pending.isEmpty();
+}
+
+bool
+FQPRequestJournal::Contains(const QByteArray& key) const
+{
+    QMutexLocker locker(&_mutex);
+    foreach (const Entry& entry, _pending) {
+        if (entry.key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QList<FQPRequestJournal::Entry>
+FQPRequestJournal::GetPending() const
+{
+    QMutexLocker locker(&_mutex);
+    return _pending;
+}
+
+void
+FQPRequestJournal::Append(const Entry& entry)
+{
+    QMutexLocker locker(&_mutex);
+    _WriteRecord(_AddRecord(entry));
+    _pending.append(entry);
+}
+
+void
+FQPRequestJournal::MarkDone(const QByteArray& key)
+{
+    QMutexLocker locker(&_mutex);
+    for (int i = 0 ; i < _pending.size() ; ++i) {
+        if (_pending[i].key == key) {
+            _pending.removeAt(i);
+            QJsonObject record;
+            record["op"] = QStringLiteral("done");
+            record["key"] = QString::fromLatin1(key);
+            _WriteRecord(record);
+            _doneRecords++;
+            break;
+        }
+    }
+    if ((_doneRecords >= _compactionThreshold) &&
+        (_doneRecords > _pending.size())) {
+        _CompactLocked();
+    }
+}
+
+void
+FQPRequestJournal::SetSyncPolicy(int batchSize, int intervalMs)
+{
+    QMutexLocker locker(&_mutex);
+    _batchSize = qMax(1, batchSize);
+    _syncTimer.setInterval(qMax(0, intervalMs));
+}
+
+void
+FQPRequestJournal::SetCompactionThreshold(int doneRecords)
+{
+    QMutexLocker locker(&_mutex);
+    _compactionThreshold = qMax(1, doneRecords);
+}
+
+void
+FQPRequestJournal::Sync()
+{
+    QMutexLocker locker(&_mutex);
+    _SyncLocked();
+}
+
+void
+FQPRequestJournal::_Load()
+{
+    if (!_file.open(QIODevice::ReadOnly)) {
+        // Nothing journaled yet.
+        return;
+    }
+    while (!_file.atEnd()) {
+        QByteArray line = _file.readLine();
+        _tornTail = !line.endsWith('\n');
+        line = line.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonDocument doc = QJsonDocument::fromJson(line);
+        if (!doc.isObject()) {
+            // Most likely a record torn by a crash before it was synced.
+            qDebug() << "FQPRequestJournal: skipping bad record " << line;
+            continue;
+        }
+        QJsonObject record = doc.object();
+        QString op = record["op"].toString();
+        QByteArray key = record["key"].toString().toLatin1();
+        if (op == "add") {
+            Entry entry;
+            entry.key = key;
+            entry.url = QUrl(record["url"].toString());
+            entry.method = record["method"].toString().toLatin1();
+            entry.content = record["content"].toString().toUtf8();
+            _pending.append(entry);
+        } else if (op == "done") {
+            for (int i = 0 ; i < _pending.size() ; ++i) {
+                if (_pending[i].key == key) {
+                    _pending.removeAt(i);
+                    break;
+                }
+            }
+            _doneRecords++;
+        }
+    }
+    _file.close();
+}
+
+bool
+FQPRequestJournal::_OpenForAppend()
+{
+    return _file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+void
+FQPRequestJournal::_WriteRecord(const QJsonObject& record)
+{
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if (_file.write(line) != line.size()) {
+        qDebug() << "FQPRequestJournal: write failed: " << _file.errorString();
+    }
+    _unsyncedRecords++;
+    if (_unsyncedRecords >= _batchSize) {
+        _SyncLocked();
+    } else if (_unsyncedRecords == 1) {
+        // We may be called from any thread, but the timer has to be started
+        // from ours.
+        QMetaObject::invokeMethod(&_syncTimer, "start", Qt::QueuedConnection);
+    }
+}
+
+void
+FQPRequestJournal::_SyncLocked()
+{
+    if (_unsyncedRecords == 0 || !_file.isOpen()) {
+        return;
+    }
+    _file.flush();
+#ifdef Q_OS_WIN
+    _commit(_file.handle());
+#else
+    ::fsync(_file.handle());
+#endif
+    _unsyncedRecords = 0;
+}
+
+void
+FQPRequestJournal::_CompactLocked()
+{
+    _SyncLocked();
+
+    QSaveFile compacted(_file.fileName());
+    if (!compacted.open(QIODevice::WriteOnly)) {
+        qDebug() << "FQPRequestJournal: unable to compact: "
+                 << compacted.errorString();
+        return;
+    }
+    foreach (const Entry& entry, _pending) {
+        QByteArray line =
+            QJsonDocument(_AddRecord(entry)).toJson(QJsonDocument::Compact);
+        line.append('\n');
+        compacted.write(line);
+    }
+    _file.close();
+    // commit() syncs and renames over the old journal.
+    if (!compacted.commit()) {
+        qDebug() << "FQPRequestJournal: unable to compact: "
+                 << compacted.errorString();
+    } else {
+        _doneRecords = 0;
+    }
+    if (!_OpenForAppend()) {
+        qDebug() << "FQPRequestJournal: unable to reopen: "
+                 << _file.errorString();
+    }
+}
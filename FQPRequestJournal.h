@@ -0,0 +1,92 @@
+#ifndef FQPREQUESTJOURNAL_H
+#define FQPREQUESTJOURNAL_H
+
+#include "FQPTypes.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+
+// Write-ahead journal for mutating requests that we couldn't send, either
+// because we were offline or because the send failed transiently. The file is
+// append only: one compact JSON object per line, an "add" record when a
+// request is journaled and a "done" record once it has been replayed. On
+// open, the records are read back to rebuild the pending requests in order, so
+// requests survive a restart.
+//
+// Appends are only fsync'd in batches (every N records, or after a short
+// interval), so a burst of writes doesn't pay for a disk sync each. Once
+// enough "done" records pile up, the file is rewritten with only the pending
+// requests.
+class FQPRequestJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const QByteArray IdempotencyHeaderName;
+
+    struct Entry {
+        QByteArray key;
+        QUrl url;
+        QByteArray method;
+        QByteArray content;
+    };
+
+    // Opens (or creates) the journal at path and loads any pending requests.
+    // Throws FQPException if the file can't be opened.
+    explicit FQPRequestJournal(const QString& path, QObject *parent = 0);
+
+    virtual ~FQPRequestJournal();
+
+    // A new key to send as the Idempotency-Key, so the server can drop
+    // requests that it already processed before we lost the reply.
+    static QByteArray NewKey();
+
+    bool IsEmpty() const;
+    bool Contains(const QByteArray& key) const;
+
+    // The pending requests, in the order they were journaled.
+    QList<Entry> GetPending() const;
+
+    void Append(const Entry& entry);
+    void MarkDone(const QByteArray& key);
+
+    // Sync after batchSize unsynced records, or intervalMs after the first
+    // unsynced record, whichever comes first.
+    void SetSyncPolicy(int batchSize, int intervalMs);
+
+    // Compact once this many "done" records are in the file (and they
+    // outnumber the pending ones).
+    void SetCompactionThreshold(int doneRecords);
+
+public slots:
+    void Sync();
+
+protected:
+    void _Load();
+    bool _OpenForAppend();
+    void _WriteRecord(const QJsonObject& record);
+    void _SyncLocked();
+    void _CompactLocked();
+
+private:
+    mutable QMutex _mutex;
+    QFile _file;
+    QList<Entry> _pending;
+    QTimer _syncTimer;
+
+    int _unsyncedRecords;
+    int _doneRecords;
+    int _batchSize;
+    int _compactionThreshold;
+    // The file ends in the middle of a record, which the next one mustn't be
+    // appended to.
+    bool _tornTail;
+};
+
+#endif // FQPREQUESTJOURNAL_H
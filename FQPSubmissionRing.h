@@ -0,0 +1,127 @@
+#ifndef FQPSUBMISSIONRING_H
+#define FQPSUBMISSIONRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded, lock-free, multiple producer, single consumer ring. Any thread can
+// TryPush, but only one thread (the access manager's) may TryPop.
+//
+// Each cell carries a sequence number that says whose turn it is: a producer
+// claims a cell by bumping the enqueue position, fills it, then publishes it
+// by advancing the sequence. The consumer only reads cells that have been
+// published, so producers never wait on each other or on the consumer, except
+// to retry the compare-and-swap on the enqueue position.
+template <typename T>
+class FQPSubmissionRing
+{
+public:
+    // capacity is rounded up to a power of two.
+    explicit FQPSubmissionRing(std::size_t capacity = 1024) :
+        _enqueuePos(0),
+        _dequeuePos(0)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        _cells = std::vector<Cell>(size);
+        for (std::size_t i = 0 ; i < size ; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the ring is full.
+    bool TryPush(T value)
+    {
+        Cell* cell;
+        std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &_cells[pos & _mask];
+            std::size_t sequence =
+                cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) -
+                static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The consumer hasn't caught up to this cell yet.
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if there's nothing (published) to pop.
+    bool TryPop(T& value)
+    {
+        Cell* cell = &_cells[_dequeuePos & _mask];
+        std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        if (sequence != _dequeuePos + 1) {
+            return false;
+        }
+        value = std::move(cell->data);
+        // Don't hold on to anything (like shared pointers) until the cell is
+        // reused.
+        cell->data = T();
+        cell->sequence.store(_dequeuePos + _mask + 1,
+                             std::memory_order_release);
+        ++_dequeuePos;
+        return true;
+    }
+
+    // Consumer only. False while any push has claimed a cell, even if it
+    // hasn't been published yet (so TryPop can't get it).
+    bool IsEmpty() const
+    {
+        return _enqueuePos.load(std::memory_order_acquire) == _dequeuePos;
+    }
+
+private:
+    struct Cell {
+        Cell() : sequence(0) {}
+        // Only so the vector can be sized. Cells are never copied once in use.
+        Cell(const Cell& other) :
+            sequence(other.sequence.load(std::memory_order_relaxed)),
+            data(other.data) {}
+        Cell& operator=(const Cell& other) {
+            sequence.store(other.sequence.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+            data = other.data;
+            return *this;
+        }
+
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    FQPSubmissionRing(const FQPSubmissionRing&);
+    FQPSubmissionRing& operator=(const FQPSubmissionRing&);
+
+    // Keep the producers' and the consumer's positions on separate cache
+    // lines (and off the lines of whatever we're embedded in) so they don't
+    // bounce a line between them. We pad rather than use alignas, which would
+    // make every class holding a ring over-aligned, and plain new doesn't
+    // honor that before C++17.
+    static const std::size_t CacheLineBytes = 64;
+
+    std::vector<Cell> _cells;
+    std::size_t _mask;
+    char _enqueuePadding[CacheLineBytes];
+    std::atomic<std::size_t> _enqueuePos;
+    char _dequeuePadding[CacheLineBytes - sizeof(std::atomic<std::size_t>)];
+    std::size_t _dequeuePos;
+    char _endPadding[CacheLineBytes - sizeof(std::size_t)];
+};
+
+#endif // FQPSUBMISSIONRING_H
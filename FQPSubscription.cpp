@@ -0,0 +1,375 @@
+#include "FQPSubscription.h"
+
+#include "FQPMemoryBudget.h"
+#include "FQPReplyHandler.h"
+
+#include <QDebug>
+#include <QNetworkAccessManager>
+
+const QByteArray FQPSubscription::LastEventIdHeaderName = "Last-Event-ID";
+const QByteArray FQPSubscription::DefaultEventType = "message";
+
+static const int DefaultRetryMs = 3000;
+static const int MaxRetryMs = 60000;
+
+FQPSubscription::FQPSubscription(QNetworkAccessManagerPtr accessManager,
+                                 const QNetworkRequest& request,
+                                 QObject *parent) :
+    QObject(parent),
+    _accessManager(accessManager),
+    _request(request),
+    _reply(NULL),
+    // Parented, so it moves to the access manager's thread with us.
+    _reconnectTimer(this),
+    _open(false),
+    _headersRead(false),
+    _eventStream(false),
+    _retryMs(DefaultRetryMs),
+    _failures(0),
+    _reservedBytes(0),
+    _readPaused(false)
+{
+    _request.setRawHeader("Accept",
+                          "text/event-stream, application/x-ndjson");
+    _request.setRawHeader("Cache-Control", "no-cache");
+    _reconnectTimer.setSingleShot(true);
+    connect(&_reconnectTimer, &QTimer::timeout, this, &FQPSubscription::Open);
+}
+
+FQPSubscription::~FQPSubscription()
+{
+    Close();
+}
+
+void
+FQPSubscription::Open()
+{
+    QNetworkAccessManagerSharedPtr accessManager = _accessManager.lock();
+    if (!accessManager) {
+        return;
+    }
+    if (_reply) {
+        _reply->disconnect(this);
+        _reply->abort();
+        _reply->deleteLater();
+    }
+    _open = true;
+    _headersRead = false;
+    _eventStream = false;
+    _pending.clear();
+    _eventType.clear();
+    _eventData.clear();
+    _ReleaseReserved(true);
+
+    QNetworkRequest request = _request;
+    if (!_lastEventId.isEmpty()) {
+        request.setRawHeader(LastEventIdHeaderName, _lastEventId);
+    }
+    _reply = accessManager->get(request);
+    QObject::connect(_reply, &QNetworkReply::readyRead,
+                     this, &FQPSubscription::_OnReadyRead);
+    QObject::connect(_reply, &QNetworkReply::finished,
+                     this, &FQPSubscription::_OnFinished);
+    QObject::connect(_reply, &QNetworkReply::sslErrors,
+                     this, &FQPSubscription::_OnSslErrors);
+    if (_memoryBudget) {
+        // So when we stop reading, the rest waits in the socket.
+        _reply->setReadBufferSize(FQPReplyHandler::ReadBufferBytes);
+    }
+}
+
+void
+FQPSubscription::Close()
+{
+    _open = false;
+    _reconnectTimer.stop();
+    if (_reply) {
+        _reply->disconnect(this);
+        _reply->abort();
+        _reply->deleteLater();
+        _reply = NULL;
+    }
+    _pending.clear();
+    _eventData.clear();
+    _ReleaseReserved(true);
+}
+
+QByteArray
+FQPSubscription::GetLastEventId() const
+{
+    return _lastEventId;
+}
+
+void
+FQPSubscription::SetMemoryBudget(const FQPMemoryBudgetSharedPtr& memoryBudget)
+{
+    _memoryBudget = memoryBudget;
+}
+
+void
+FQPSubscription::_OnReadyRead()
+{
+    if (!_headersRead) {
+        // First bytes of this connection. Decide how to read them.
+        QByteArray contentType =
+            _reply->header(QNetworkRequest::ContentTypeHeader).toByteArray();
+        _BeginStream(contentType.startsWith("text/event-stream"));
+    }
+    _ReadAvailable();
+}
+
+void
+FQPSubscription::_OnFinished()
+{
+    QNetworkReply::NetworkError error = _reply->error();
+    int status =
+        _reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    // The rest is at most the reply's read buffer, so we take it even if
+    // we're over the budget.
+    _Append(_reply->readAll());
+    _EndStream();
+    _eventData.clear();
+    _ReleaseReserved(true);
+
+    _reply->deleteLater();
+    _reply = NULL;
+    qDebug() << "FQPSubscription: stream ended: " << status << " " << error;
+    if (_IsPermanentFailure(status)) {
+        // Asking again won't help.
+        qDebug() << "FQPSubscription: not reconnecting after " << status;
+        _open = false;
+    }
+    emit Disconnected(error);
+    if (_open) {
+        _ScheduleReconnect();
+    }
+}
+
+bool
+FQPSubscription::_IsPermanentFailure(int status)
+{
+    // 204 is how an SSE server tells us to stop. Client errors won't go away
+    // by themselves, except for timeouts and rate limiting.
+    return (status == 204) ||
+        ((status >= 400) && (status < 500) && (status != 408) &&
+         (status != 429));
+}
+
+void
+FQPSubscription::_ReadAvailable()
+{
+    if (!_reply || _readPaused) {
+        return;
+    }
+    qint64 available = _reply->bytesAvailable();
+    if (available <= 0) {
+        return;
+    }
+    if (!_memoryBudget) {
+        _Append(_reply->readAll());
+        return;
+    }
+
+    qint64 maxBytes = _memoryBudget->GetMaxResponseBytes();
+    if ((maxBytes > 0) && (_GetBufferedBytes() + available > maxBytes)) {
+        _FailTooLarge(_GetBufferedBytes() + available);
+        return;
+    }
+    qint64 reserved = _memoryBudget->Reserve(available, _reservedBytes);
+    _reservedBytes += reserved;
+    if (reserved > 0) {
+        _Append(_reply->read(reserved));
+    }
+    _ReleaseReserved(false);
+    if (reserved < available) {
+        _readPaused = true;
+        QObject::connect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                         this, &FQPSubscription::_OnMemoryReleased,
+                         Qt::UniqueConnection);
+        _memoryBudget->Pause(_reservedBytes);
+    }
+}
+
+qint64
+FQPSubscription::_GetBufferedBytes() const
+{
+    return _pending.size() + _eventData.size();
+}
+
+void
+FQPSubscription::_ReleaseReserved(bool all)
+{
+    if (!_memoryBudget) {
+        return;
+    }
+    if (all && _readPaused) {
+        _readPaused = false;
+        QObject::disconnect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                            this, &FQPSubscription::_OnMemoryReleased);
+        _memoryBudget->Resume(_reservedBytes);
+    }
+    qint64 keep = all ? 0 : qMin(_reservedBytes, _GetBufferedBytes());
+    _memoryBudget->Release(_reservedBytes - keep);
+    _reservedBytes = keep;
+}
+
+void
+FQPSubscription::_OnMemoryReleased()
+{
+    if (!_readPaused) {
+        return;
+    }
+    _readPaused = false;
+    QObject::disconnect(_memoryBudget.get(), &FQPMemoryBudget::Released,
+                        this, &FQPSubscription::_OnMemoryReleased);
+    _memoryBudget->Resume(_reservedBytes);
+    _ReadAvailable();
+}
+
+void
+FQPSubscription::_FailTooLarge(qint64 size)
+{
+    qDebug() << "FQPSubscription: " << size << " bytes without an event, over "
+             << "the limit of " << _memoryBudget->GetMaxResponseBytes();
+    _reply->disconnect(this);
+    _reply->abort();
+    _reply->deleteLater();
+    _reply = NULL;
+    _pending.clear();
+    _eventType.clear();
+    _eventData.clear();
+    _ReleaseReserved(true);
+    emit Disconnected(QNetworkReply::UnknownContentError);
+    if (_open) {
+        _ScheduleReconnect();
+    }
+}
+
+void
+FQPSubscription::_BeginStream(bool eventStream)
+{
+    _headersRead = true;
+    _eventStream = eventStream;
+}
+
+void
+FQPSubscription::_Append(const QByteArray& bytes)
+{
+    _pending.append(bytes);
+    _Parse();
+}
+
+void
+FQPSubscription::_EndStream()
+{
+    // Whatever was left, without a trailing newline.
+    if (!_eventStream && !_pending.trimmed().isEmpty()) {
+        emit EventReceived(DefaultEventType, QByteArray(), _pending.trimmed());
+    }
+    _pending.clear();
+}
+
+void
+FQPSubscription::_OnSslErrors(const QList<QSslError>& errors)
+{
+    // Same as FQPReplyHandler, for the same reason.
+    _reply->ignoreSslErrors(errors);
+}
+
+void
+FQPSubscription::_Parse()
+{
+    // Hand over each complete line, keeping the rest for the next read. We
+    // only remove what we've consumed once, at the end.
+    int start = 0;
+    int size = _pending.size();
+    for (int i = 0 ; i < size ; ++i) {
+        char c = _pending.at(i);
+        if ((c != '\n') && (c != '\r')) {
+            continue;
+        }
+        if ((c == '\r') && (i + 1 == size)) {
+            // Might be half of a "\r\n". Wait for the next byte.
+            break;
+        }
+        QByteArray line = _pending.mid(start, i - start);
+        if ((c == '\r') && (_pending.at(i + 1) == '\n')) {
+            ++i;
+        }
+        start = i + 1;
+
+        if (_eventStream) {
+            _ProcessEventStreamLine(line);
+        } else if (!line.trimmed().isEmpty()) {
+            _failures = 0;
+            emit EventReceived(DefaultEventType, QByteArray(), line);
+        }
+    }
+    _pending.remove(0, start);
+}
+
+void
+FQPSubscription::_ProcessEventStreamLine(const QByteArray& line)
+{
+    if (line.isEmpty()) {
+        _DispatchEvent();
+        return;
+    }
+    if (line.startsWith(':')) {
+        // Comment (usually a keep-alive).
+        return;
+    }
+    QByteArray field = line;
+    QByteArray value;
+    int colon = line.indexOf(':');
+    if (colon >= 0) {
+        field = line.left(colon);
+        value = line.mid(colon + 1);
+        if (value.startsWith(' ')) {
+            value.remove(0, 1);
+        }
+    }
+
+    if (field == "data") {
+        _eventData.append(value);
+        _eventData.append('\n');
+    } else if (field == "event") {
+        _eventType = value;
+    } else if (field == "id") {
+        _lastEventId = value;
+    } else if (field == "retry") {
+        bool ok = false;
+        int retryMs = value.toInt(&ok);
+        if (ok && (retryMs >= 0)) {
+            _retryMs = retryMs;
+        }
+    }
+}
+
+void
+FQPSubscription::_DispatchEvent()
+{
+    if (_eventData.isEmpty()) {
+        _eventType.clear();
+        return;
+    }
+    // Drop the newline after the last data line.
+    _eventData.chop(1);
+    _failures = 0;
+    emit EventReceived(_eventType.isEmpty() ? DefaultEventType : _eventType,
+                       _lastEventId, _eventData);
+    _eventType.clear();
+    _eventData.clear();
+}
+
+void
+FQPSubscription::_ScheduleReconnect()
+{
+    // Back off while we keep failing without getting any events.
+    int delay = _retryMs;
+    for (int i = 0 ; (i < _failures) && (delay < MaxRetryMs) ; ++i) {
+        delay *= 2;
+    }
+    _failures++;
+    _reconnectTimer.start(qMin(delay, MaxRetryMs));
+}
@@ -0,0 +1,115 @@
+#ifndef FQPSUBSCRIPTION_H
+#define FQPSUBSCRIPTION_H
+
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QTimer>
+
+#include "FQPTypes.h"
+
+FQP_DECLARE_PTRS(QNetworkAccessManager);
+FQP_DECLARE_PTRS(FQPMemoryBudget);
+
+// A long-lived GET that the server pushes events down, instead of us polling.
+// If the server answers with text/event-stream, we parse Server-Sent Events.
+// Anything else is read as a stream of JSON documents, one per line. Either
+// way, we parse as the bytes arrive and emit each event as soon as it's
+// complete.
+//
+// When the stream ends or fails, we reconnect after a delay (the server's
+// "retry:", backing off while we keep failing) and send Last-Event-ID, so the
+// server can pick up where we left off. We don't reconnect after a 204 or a
+// client error (other than 408 or 429), since those won't change.
+//
+// With a memory budget, what we've read but not yet dispatched (a partial
+// line, or the data lines of an event that hasn't ended) is reserved from it
+// like any response buffer, and we stop reading while it's used up. More than
+// the budget's maximum response size without an event ending fails the
+// connection with UnknownContentError, and we reconnect.
+class FQPSubscription : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const QByteArray LastEventIdHeaderName;
+    // The SSE event type when the server doesn't send one, and the type of
+    // every JSON line.
+    static const QByteArray DefaultEventType;
+
+    explicit FQPSubscription(QNetworkAccessManagerPtr accessManager,
+                             const QNetworkRequest& request,
+                             QObject *parent = 0);
+
+    virtual ~FQPSubscription();
+
+    // Both have to be called on the access manager's thread.
+    Q_INVOKABLE void Open();
+    Q_INVOKABLE void Close();
+
+    QByteArray GetLastEventId() const;
+
+    // Call before Open().
+    void SetMemoryBudget(const FQPMemoryBudgetSharedPtr& memoryBudget);
+
+signals:
+    void EventReceived(const QByteArray& type,
+                       const QByteArray& id,
+                       const QByteArray& data);
+    // The stream ended. We'll reconnect unless we were closed.
+    void Disconnected(QNetworkReply::NetworkError error);
+
+protected:
+    static bool _IsPermanentFailure(int status);
+
+    // The parsing, apart from the reply, so it can be fed directly.
+    void _BeginStream(bool eventStream);
+    void _Append(const QByteArray& bytes);
+    void _EndStream();
+
+    // Reads what the reply has, as far as the budget allows.
+    void _ReadAvailable();
+    // What we're holding: read, but not dispatched yet.
+    qint64 _GetBufferedBytes() const;
+    // Gives back what's been dispatched. With all, everything we hold.
+    void _ReleaseReserved(bool all);
+    void _FailTooLarge(qint64 size);
+
+    void _Parse();
+    void _ProcessEventStreamLine(const QByteArray& line);
+    void _DispatchEvent();
+    void _ScheduleReconnect();
+
+protected slots:
+    virtual void _OnReadyRead();
+    virtual void _OnFinished();
+    virtual void _OnSslErrors(const QList<QSslError>& errors);
+    virtual void _OnMemoryReleased();
+
+private:
+    QNetworkAccessManagerPtr _accessManager;
+    QNetworkRequest _request;
+    QNetworkReply *_reply;
+    QTimer _reconnectTimer;
+
+    bool _open;
+    bool _headersRead;
+    bool _eventStream;
+    // Bytes received that aren't a complete line yet.
+    QByteArray _pending;
+
+    // The SSE event being built.
+    QByteArray _eventType;
+    QByteArray _eventData;
+    QByteArray _lastEventId;
+
+    int _retryMs;
+    int _failures;
+
+    FQPMemoryBudgetSharedPtr _memoryBudget;
+    qint64 _reservedBytes;
+    bool _readPaused;
+};
+
+#endif // FQPSUBSCRIPTION_H
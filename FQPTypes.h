@@ -2,6 +2,7 @@
 #define FQPTYPES_H
 
 #include <memory>
+#include <type_traits>
 #include <QVariant>
 
 class FQPException
@@ -76,4 +77,11 @@ TYPE FQPType_GetValueFromVariant(const QVariant& variant) {
     }
 }
 
+// What a handler taking a TYPE (which may be a const reference) gets when
+// there's no result to give it.
+template <typename TYPE>
+typename std::decay<TYPE>::type FQPType_DefaultValue() {
+    return typename std::decay<TYPE>::type();
+}
+
 #endif // FQPTYPES_H
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Throughput/latency benchmark for FQPClient against an in-process mock
+# server.
+#
+#-------------------------------------------------
+
+QT       += network
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = FQPClientBench
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+# The library is built by FQPClientAll.pro, two levels up from us. On macOS,
+# FQPClient.pro builds it as a framework.
+macx {
+    LIBS += -F$$OUT_PWD/../.. -framework FQPClient
+} else {
+    LIBS += -L$$OUT_PWD/../.. -lFQPClient
+}
+unix:QMAKE_RPATHDIR += $$OUT_PWD/../..
+
+SOURCES += \
+    FQPMockServer.cpp \
+    main.cpp \
+
+HEADERS += \
+    FQPMockServer.h \
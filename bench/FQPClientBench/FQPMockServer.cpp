@@ -0,0 +1,304 @@
+#include "FQPMockServer.h"
+
+#include "FQPTypes.h"
+
+#include <QDebug>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QTcpSocket>
+#include <QTimer>
+
+#ifndef QT_NO_SSL
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QSslSocket>
+#endif
+
+static QByteArray
+_ReasonPhrase(int status)
+{
+    switch (status) {
+    case 301:
+        return "Moved Permanently";
+    case 302:
+        return "Found";
+    case 303:
+        return "See Other";
+    case 307:
+        return "Temporary Redirect";
+    case 308:
+        return "Permanent Redirect";
+    default:
+        return "Redirect";
+    }
+}
+
+FQPMockServer::FQPMockServer(const FQPMockServerConfig& config) :
+    QTcpServer(),
+    _config(config),
+    _port(0),
+    _random(42),
+    _errorDistribution(0.0, 1.0)
+{
+    QJsonObject body;
+    body["count"] = 42;
+    body["name"] = QStringLiteral("bench");
+    body["padding"] = QString();
+    int overhead = QJsonDocument(body).toJson(QJsonDocument::Compact).size();
+    body["padding"] = QString(qMax(0, _config.payloadBytes - overhead), 'x');
+    _body = QJsonDocument(body).toJson(QJsonDocument::Compact);
+}
+
+FQPMockServer::~FQPMockServer()
+{
+    Stop();
+}
+
+void
+FQPMockServer::Start()
+{
+    moveToThread(&_thread);
+    _thread.start();
+    QMetaObject::invokeMethod(this, "_Listen", Qt::BlockingQueuedConnection);
+    if (_port == 0) {
+        throw FQPException("Mock server unable to listen");
+    }
+}
+
+void
+FQPMockServer::Stop()
+{
+    if (!_thread.isRunning()) {
+        return;
+    }
+    QMetaObject::invokeMethod(this, "_Close", Qt::BlockingQueuedConnection);
+    _thread.quit();
+    _thread.wait();
+}
+
+QUrl
+FQPMockServer::GetBaseUrl() const
+{
+    bool tls = !_config.tlsCertificate.isEmpty();
+    return QUrl(QString("%1://127.0.0.1:%2/").arg(tls ? "https" : "http")
+                .arg(_port));
+}
+
+QList<FQPMockRequest>
+FQPMockServer::GetRequests() const
+{
+    QMutexLocker locker(&_requestsMutex);
+    return _requests;
+}
+
+void
+FQPMockServer::ClearRequests()
+{
+    QMutexLocker locker(&_requestsMutex);
+    _requests.clear();
+}
+
+void
+FQPMockServer::incomingConnection(qintptr socketDescriptor)
+{
+    QTcpSocket* socket = NULL;
+    if (!_config.tlsCertificate.isEmpty()) {
+#ifndef QT_NO_SSL
+        QSslSocket* sslSocket = new QSslSocket(this);
+        sslSocket->setSocketDescriptor(socketDescriptor);
+        sslSocket->setLocalCertificate(QSslCertificate(_config.tlsCertificate));
+        sslSocket->setPrivateKey(QSslKey(_config.tlsKey, QSsl::Rsa));
+        sslSocket->startServerEncryption();
+        socket = sslSocket;
+#else
+        qWarning() << "FQPMockServer: no SSL support for https";
+        QTcpSocket refused;
+        refused.setSocketDescriptor(socketDescriptor);
+        refused.abort();
+        return;
+#endif
+    } else {
+        socket = new QTcpSocket(this);
+        socket->setSocketDescriptor(socketDescriptor);
+    }
+    connect(socket, &QTcpSocket::readyRead,
+            this, &FQPMockServer::_OnReadyRead);
+    connect(socket, &QTcpSocket::disconnected,
+            this, &FQPMockServer::_OnDisconnected);
+}
+
+void
+FQPMockServer::_Listen()
+{
+    if (listen(QHostAddress::LocalHost, 0)) {
+        _port = serverPort();
+    } else {
+        qWarning() << "FQPMockServer: " << errorString();
+    }
+}
+
+void
+FQPMockServer::_Close()
+{
+    close();
+    foreach (QTcpSocket* socket, _buffers.keys()) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    _buffers.clear();
+}
+
+void
+FQPMockServer::_OnReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+    _buffers[socket].append(socket->readAll());
+    _HandleRequests(socket);
+}
+
+void
+FQPMockServer::_OnDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+    _buffers.remove(socket);
+    socket->deleteLater();
+}
+
+void
+FQPMockServer::_HandleRequests(QTcpSocket* socket)
+{
+    QByteArray& buffer = _buffers[socket];
+    for (;;) {
+        int headerEnd = buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            return;
+        }
+        // We only care about the length of the body (to skip it) and whether
+        // to keep the connection, unless we're recording, or redirecting.
+        QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+        QList<QByteArray> requestLine = lines[0].trimmed().split(' ');
+        FQPMockRequest request;
+        request.method = requestLine.value(0);
+        request.path = requestLine.value(1);
+        int contentLength = 0;
+        bool keepAlive = true;
+        for (int i = 1 ; i < lines.size() ; ++i) {
+            QByteArray line = lines[i].trimmed();
+            int colon = line.indexOf(':');
+            if (colon < 0) {
+                continue;
+            }
+            QByteArray name = line.left(colon).trimmed().toLower();
+            QByteArray value = line.mid(colon + 1).trimmed();
+            if (name == "content-length") {
+                contentLength = value.toInt();
+            } else if (name == "connection") {
+                keepAlive = (value.toLower() != "close");
+            }
+            if (_config.recordRequests) {
+                request.headers.insert(name, value);
+            }
+        }
+        int requestSize = headerEnd + 4 + contentLength;
+        if (buffer.size() < requestSize) {
+            return;
+        }
+        if (_config.recordRequests) {
+            request.body = buffer.mid(headerEnd + 4, contentLength);
+            QMutexLocker locker(&_requestsMutex);
+            _requests.append(request);
+        }
+        buffer.remove(0, requestSize);
+
+        auto redirect = _config.redirects.constFind(request.path);
+        if (redirect != _config.redirects.constEnd()) {
+            _Redirect(socket, redirect.value(), keepAlive);
+        } else if (_config.latencyMs > 0) {
+            QTimer::singleShot(_config.latencyMs, socket,
+                               [this, socket, keepAlive]() {
+                                   _Respond(socket, keepAlive);
+                               });
+        } else {
+            _Respond(socket, keepAlive);
+        }
+    }
+}
+
+void
+FQPMockServer::_Respond(QTcpSocket* socket, bool keepAlive)
+{
+    bool fail = (_config.errorRate > 0.0) &&
+        (_errorDistribution(_random) < _config.errorRate);
+
+    QByteArray response = fail ? "HTTP/1.1 503 Service Unavailable\r\n" :
+        "HTTP/1.1 200 OK\r\n";
+    response.append("Content-Type: application/json\r\n");
+    response.append(keepAlive ? "Connection: keep-alive\r\n" :
+                    "Connection: close\r\n");
+    if (_config.chunked) {
+        response.append("Transfer-Encoding: chunked\r\n\r\n");
+        // Don't let Nagle put the chunks back together.
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        QList<QByteArray> pieces;
+        pieces.append(response);
+        int chunkBytes = qMax(1, _config.chunkBytes);
+        for (int offset = 0 ; offset < _body.size() ; offset += chunkBytes) {
+            QByteArray chunk = _body.mid(offset, chunkBytes);
+            QByteArray piece = QByteArray::number(chunk.size(), 16);
+            piece.append("\r\n");
+            piece.append(chunk);
+            piece.append("\r\n");
+            pieces.append(piece);
+        }
+        pieces.append("0\r\n\r\n");
+        _WritePieces(socket, pieces, keepAlive);
+        return;
+    }
+    response.append("Content-Length: ");
+    response.append(QByteArray::number(_body.size()));
+    response.append("\r\n\r\n");
+    response.append(_body);
+    _WritePieces(socket, QList<QByteArray>() << response, keepAlive);
+}
+
+void
+FQPMockServer::_Redirect(QTcpSocket* socket, const FQPMockRedirect& redirect,
+                         bool keepAlive)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(redirect.status) +
+        " " + _ReasonPhrase(redirect.status) + "\r\n";
+    response.append("Location: " + redirect.location + "\r\n");
+    response.append(keepAlive ? "Connection: keep-alive\r\n" :
+                    "Connection: close\r\n");
+    response.append("Content-Length: 0\r\n\r\n");
+    _WritePieces(socket, QList<QByteArray>() << response, keepAlive);
+}
+
+void
+FQPMockServer::_WritePieces(QTcpSocket* socket, QList<QByteArray> pieces,
+                            bool keepAlive)
+{
+    while (!pieces.isEmpty()) {
+        socket->write(pieces.takeFirst());
+        socket->flush();
+        if (!pieces.isEmpty() && (_config.chunkDelayMs > 0)) {
+            QTimer::singleShot(_config.chunkDelayMs, socket,
+                               [this, socket, pieces, keepAlive]() {
+                                   _WritePieces(socket, pieces, keepAlive);
+                               });
+            return;
+        }
+    }
+    if (!keepAlive) {
+        socket->disconnectFromHost();
+    }
+}
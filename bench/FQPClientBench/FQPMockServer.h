@@ -0,0 +1,125 @@
+#ifndef FQPMOCKSERVER_H
+#define FQPMOCKSERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QTcpServer>
+#include <QThread>
+#include <QUrl>
+
+#include <random>
+
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+
+// Answer for a path instead of the JSON body.
+struct FQPMockRedirect {
+    FQPMockRedirect() : status(302) {}
+    FQPMockRedirect(int status, const QByteArray& location) :
+        status(status), location(location) {}
+
+    // 301, 302, 303, 307 or 308.
+    int status;
+    // Sent as is, so it can be relative or go to another server.
+    QByteArray location;
+};
+
+// A request the server received, as it came.
+struct FQPMockRequest {
+    QByteArray method;
+    QByteArray path;
+    // By lower-cased name.
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray body;
+};
+
+struct FQPMockServerConfig {
+    FQPMockServerConfig() :
+        latencyMs(0),
+        payloadBytes(256),
+        chunked(false),
+        chunkBytes(1024),
+        chunkDelayMs(0),
+        errorRate(0.0),
+        recordRequests(false) {}
+
+    // Delay before each response is written.
+    int latencyMs;
+    // Approximate size of the JSON body.
+    int payloadBytes;
+    // Send the body with Transfer-Encoding: chunked, in chunkBytes pieces.
+    // Each chunk is written and flushed by itself, with chunkDelayMs between
+    // them. Without a delay, the client may still read several at once.
+    bool chunked;
+    int chunkBytes;
+    int chunkDelayMs;
+    // Fraction (0..1) of requests that get a 503 instead of a 200.
+    double errorRate;
+    // Paths (like "/api/old/") to redirect instead of answering.
+    QHash<QByteArray, FQPMockRedirect> redirects;
+    // Keep every request, for GetRequests().
+    bool recordRequests;
+    // When both are set (PEM), we serve https instead of http.
+    QByteArray tlsCertificate;
+    QByteArray tlsKey;
+};
+
+// Minimal HTTP/1.1 server, on its own thread, that answers every request with
+// the same JSON body: {"count": 42, "name": "bench", "padding": "..."}. Just
+// enough to drive FQPClient without the network in the way. Error responses
+// carry the same body, so the typed Fetch handlers still get their values.
+// The tests also use it, for redirects and to see what was sent.
+class FQPMockServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit FQPMockServer(const FQPMockServerConfig& config);
+
+    virtual ~FQPMockServer();
+
+    // Listens on a local port. Throws if we can't.
+    void Start();
+    void Stop();
+
+    QUrl GetBaseUrl() const;
+
+    // What we've received, in order, if we're recording. Safe to call from
+    // any thread.
+    QList<FQPMockRequest> GetRequests() const;
+    void ClearRequests();
+
+protected:
+    virtual void incomingConnection(qintptr socketDescriptor) override;
+
+protected slots:
+    void _Listen();
+    void _Close();
+    void _OnReadyRead();
+    void _OnDisconnected();
+
+private:
+    void _HandleRequests(QTcpSocket* socket);
+    void _Respond(QTcpSocket* socket, bool keepAlive);
+    void _Redirect(QTcpSocket* socket, const FQPMockRedirect& redirect,
+                   bool keepAlive);
+    // Writes and flushes the first of pieces, and the rest after
+    // chunkDelayMs. The client doesn't send another request on the
+    // connection until it has the whole response, so they can't interleave.
+    void _WritePieces(QTcpSocket* socket, QList<QByteArray> pieces,
+                      bool keepAlive);
+
+    FQPMockServerConfig _config;
+    QByteArray _body;
+    QThread _thread;
+    quint16 _port;
+    QHash<QTcpSocket*, QByteArray> _buffers;
+    std::mt19937 _random;
+    std::uniform_real_distribution<double> _errorDistribution;
+
+    QList<FQPMockRequest> _requests;
+    mutable QMutex _requestsMutex;
+};
+
+#endif // FQPMOCKSERVER_H
@@ -0,0 +1,301 @@
+// Runs FetchRaw and typed Fetch workloads against FQPMockServer, keeping a
+// fixed number of requests in flight, and prints one JSON object per
+// workload/concurrency pair, so runs can be diffed over time:
+//
+//   {"workload": "raw", "concurrency": 8, "requests": 2000,
+//    "requests_per_sec": ..., "latency_us": {"p50": ..., "p90": ...,
+//    "p99": ..., "max": ...}, "allocs_per_request": ..., "peak_rss_kb": ...,
+//    "server": {...}}
+//
+// allocs_per_request counts operator new calls on the client's thread only,
+// so the mock server (and Qt's own HTTP thread) don't show up in it.
+//
+// The "submit" workload instead runs the client as a thread and calls FetchRaw
+// from several producer threads at once, so it measures the whole submission
+// path (building the request, the locks on the way, the ring and the drain),
+// not just the ring, which is what SubmissionBench measures.
+
+#include "FQPClient.h"
+#include "FQPMockServer.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+static std::atomic<long> AllocationCount(0);
+static thread_local bool CountAllocations = false;
+
+void* operator new(std::size_t size)
+{
+    if (CountAllocations) {
+        AllocationCount++;
+    }
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+static long
+_PeakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+    // Bytes on macOS, kilobytes everywhere else.
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static qint64
+_Percentile(const QVector<qint64>& sorted, double percentile)
+{
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    int index = static_cast<int>(percentile * (sorted.size() - 1) + 0.5);
+    return sorted[qBound(0, index, sorted.size() - 1)];
+}
+
+static QJsonObject
+_RunWorkload(FQPClient& client, const QString& workload, int concurrency,
+             int requests)
+{
+    static const QStringList typedParams = QStringList() << "count" << "name";
+
+    QEventLoop loop;
+    QElapsedTimer wallTimer;
+    QVector<qint64> latenciesUs;
+    latenciesUs.reserve(requests);
+    int started = 0;
+    int finished = 0;
+
+    std::function<void ()> startOne = [&]() {
+        if (started >= requests) {
+            return;
+        }
+        started++;
+        qint64 startNs = wallTimer.nsecsElapsed();
+        auto done = [&, startNs]() {
+            latenciesUs.append((wallTimer.nsecsElapsed() - startNs) / 1000);
+            if (++finished == requests) {
+                loop.quit();
+            } else {
+                startOne();
+            }
+        };
+        if (workload == "raw") {
+            client.FetchRaw("bench", "GET", QJsonObject(),
+                            [done](const QJsonDocument&) { done(); });
+        } else {
+            client.Fetch<int, QString>(
+                "bench", "GET", QJsonObject(), &typedParams,
+                std::function<void (int, QString)>(
+                    [done](int, QString) { done(); }));
+        }
+    };
+
+    long allocationsBefore = AllocationCount.load();
+    CountAllocations = true;
+    wallTimer.start();
+    for (int i = 0 ; i < concurrency ; ++i) {
+        startOne();
+    }
+    loop.exec();
+    qint64 elapsedNs = wallTimer.nsecsElapsed();
+    CountAllocations = false;
+    long allocations = AllocationCount.load() - allocationsBefore;
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    QJsonObject latency;
+    latency["p50"] = _Percentile(latenciesUs, 0.50);
+    latency["p90"] = _Percentile(latenciesUs, 0.90);
+    latency["p99"] = _Percentile(latenciesUs, 0.99);
+    latency["max"] = latenciesUs.isEmpty() ? 0 : latenciesUs.last();
+
+    QJsonObject result;
+    result["workload"] = workload;
+    result["concurrency"] = concurrency;
+    result["requests"] = requests;
+    result["seconds"] = elapsedNs / 1e9;
+    result["requests_per_sec"] = requests / (elapsedNs / 1e9);
+    result["latency_us"] = latency;
+    result["allocs_per_request"] = static_cast<double>(allocations) / requests;
+    result["peak_rss_kb"] = static_cast<double>(_PeakRssKb());
+    return result;
+}
+
+static QJsonObject
+_RunSubmit(const QUrl& baseUrl, int producers, int requests)
+{
+    FQPClient client(baseUrl);
+    client.start();
+
+    int perProducer = qMax(1, requests / producers);
+    int total = perProducer * producers;
+    std::atomic<int> finished(0);
+
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+    std::vector<std::thread> threads;
+    for (int p = 0 ; p < producers ; ++p) {
+        threads.emplace_back([&]() {
+                for (int i = 0 ; i < perProducer ; ++i) {
+                    client.FetchRaw("bench", "GET", QJsonObject(),
+                                    [&finished](const QJsonDocument&) {
+                                        finished++;
+                                    });
+                }
+            });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    qint64 submitNs = wallTimer.nsecsElapsed();
+    while (finished.load() < total) {
+        QThread::msleep(1);
+    }
+    qint64 elapsedNs = wallTimer.nsecsElapsed();
+
+    client.quit();
+    client.wait();
+
+    QJsonObject result;
+    result["workload"] = QString("submit");
+    result["producers"] = producers;
+    result["requests"] = total;
+    result["submit_seconds"] = submitNs / 1e9;
+    result["submissions_per_sec"] = total / (submitNs / 1e9);
+    result["seconds"] = elapsedNs / 1e9;
+    result["requests_per_sec"] = total / (elapsedNs / 1e9);
+    result["peak_rss_kb"] = static_cast<double>(_PeakRssKb());
+    return result;
+}
+
+int
+main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("FQPClient throughput/latency benchmark");
+    parser.addHelpOption();
+    QCommandLineOption requestsOption("requests",
+                                      "Requests per run.", "n", "2000");
+    QCommandLineOption concurrencyOption("concurrency",
+                                         "Comma separated requests in flight.",
+                                         "list", "1,8,32");
+    QCommandLineOption workloadsOption("workloads",
+                                       "Comma separated: raw, typed, submit.",
+                                       "list", "raw,typed,submit");
+    QCommandLineOption producersOption("producers",
+                                       "Comma separated producer threads, for "
+                                       "submit.",
+                                       "list", "1,4,8");
+    QCommandLineOption latencyOption("latency-ms",
+                                     "Server delay per response.", "ms", "0");
+    QCommandLineOption payloadOption("payload-bytes",
+                                     "Response body size.", "bytes", "256");
+    QCommandLineOption chunkedOption("chunked",
+                                     "Send chunked responses.");
+    QCommandLineOption chunkBytesOption("chunk-bytes",
+                                        "Chunk size when chunked.", "bytes",
+                                        "1024");
+    QCommandLineOption chunkDelayOption("chunk-delay-ms",
+                                        "Delay between chunks when chunked.",
+                                        "ms", "0");
+    QCommandLineOption errorRateOption("error-rate",
+                                       "Fraction of 503 responses.", "rate",
+                                       "0");
+    parser.addOption(requestsOption);
+    parser.addOption(concurrencyOption);
+    parser.addOption(workloadsOption);
+    parser.addOption(producersOption);
+    parser.addOption(latencyOption);
+    parser.addOption(payloadOption);
+    parser.addOption(chunkedOption);
+    parser.addOption(chunkBytesOption);
+    parser.addOption(chunkDelayOption);
+    parser.addOption(errorRateOption);
+    parser.process(app);
+
+    // The library logs every request, which would swamp the numbers.
+    QLoggingCategory::setFilterRules("default.debug=false");
+
+    FQPMockServerConfig config;
+    config.latencyMs = parser.value(latencyOption).toInt();
+    config.payloadBytes = parser.value(payloadOption).toInt();
+    config.chunked = parser.isSet(chunkedOption);
+    config.chunkBytes = parser.value(chunkBytesOption).toInt();
+    config.chunkDelayMs = parser.value(chunkDelayOption).toInt();
+    config.errorRate = parser.value(errorRateOption).toDouble();
+    int requests = qMax(1, parser.value(requestsOption).toInt());
+
+    QJsonObject serverConfig;
+    serverConfig["latency_ms"] = config.latencyMs;
+    serverConfig["payload_bytes"] = config.payloadBytes;
+    serverConfig["chunked"] = config.chunked;
+    serverConfig["chunk_bytes"] = config.chunkBytes;
+    serverConfig["chunk_delay_ms"] = config.chunkDelayMs;
+    serverConfig["error_rate"] = config.errorRate;
+
+    FQPMockServer server(config);
+    server.Start();
+    FQPClient client(server.GetBaseUrl());
+
+    foreach (const QString& workload,
+             parser.value(workloadsOption).split(',', QString::SkipEmptyParts)) {
+        if (workload.trimmed() == "submit") {
+            foreach (const QString& producers,
+                     parser.value(producersOption).split(',',
+                                                         QString::SkipEmptyParts)) {
+                QJsonObject result = _RunSubmit(server.GetBaseUrl(),
+                                                qMax(1, producers.toInt()),
+                                                requests);
+                result["server"] = serverConfig;
+                std::printf("%s\n", QJsonDocument(result)
+                            .toJson(QJsonDocument::Compact).constData());
+                std::fflush(stdout);
+            }
+            continue;
+        }
+        foreach (const QString& concurrency,
+                 parser.value(concurrencyOption).split(',',
+                                                       QString::SkipEmptyParts)) {
+            QJsonObject result = _RunWorkload(client, workload.trimmed(),
+                                              qMax(1, concurrency.toInt()),
+                                              requests);
+            result["server"] = serverConfig;
+            std::printf("%s\n", QJsonDocument(result)
+                        .toJson(QJsonDocument::Compact).constData());
+            std::fflush(stdout);
+        }
+    }
+
+    server.Stop();
+    return 0;
+}
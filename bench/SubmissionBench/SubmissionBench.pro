@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Contention benchmark for the cross-thread submission path.
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = SubmissionBench
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    main.cpp \
+
+HEADERS += \
+    $$PWD/../../FQPSubmissionRing.h \
@@ -0,0 +1,159 @@
+// Contention benchmark for handing requests from many producer threads to the
+// access manager's thread, the two ways FQPClient has done it:
+//  - "post": a queued invokeMethod per request, so an event post per request.
+//  - "ring": push onto an FQPSubmissionRing and post one drain per batch.
+// Prints one JSON object per run. This is only the hand-off itself. The
+// "submit" workload of FQPClientBench measures the client's whole submission
+// path.
+
+#include "FQPSubmissionRing.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Stands in for the request/reply pair.
+typedef std::shared_ptr<int> Submission;
+
+static const int SubmissionsPerProducer = 100000;
+
+static QJsonObject
+_Result(const char* mode, int producers, long submissions, qint64 nsecs,
+        long wakeups)
+{
+    double seconds = nsecs / 1e9;
+    QJsonObject result;
+    result["mode"] = QString(mode);
+    result["producers"] = producers;
+    result["submissions"] = static_cast<double>(submissions);
+    result["seconds"] = seconds;
+    result["submissions_per_sec"] = submissions / seconds;
+    result["consumer_wakeups"] = static_cast<double>(wakeups);
+    return result;
+}
+
+static QJsonObject
+_RunPost(int producers)
+{
+    QThread consumerThread;
+    consumerThread.start();
+    QObject* context = new QObject();
+    context->moveToThread(&consumerThread);
+
+    std::atomic<long> consumed(0);
+    std::atomic<long> wakeups(0);
+    long total = static_cast<long>(producers) * SubmissionsPerProducer;
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::thread> threads;
+    for (int p = 0 ; p < producers ; ++p) {
+        threads.emplace_back([&]() {
+                for (int i = 0 ; i < SubmissionsPerProducer ; ++i) {
+                    Submission submission = std::make_shared<int>(i);
+                    QMetaObject::invokeMethod(
+                        context,
+                        [submission, &consumed, &wakeups]() {
+                            wakeups++;
+                            consumed++;
+                        },
+                        Qt::QueuedConnection);
+                }
+            });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    while (consumed.load() < total) {
+        QThread::yieldCurrentThread();
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+
+    consumerThread.quit();
+    consumerThread.wait();
+    delete context;
+    return _Result("post", producers, total, nsecs, wakeups.load());
+}
+
+static QJsonObject
+_RunRing(int producers)
+{
+    QThread consumerThread;
+    consumerThread.start();
+    QObject* context = new QObject();
+    context->moveToThread(&consumerThread);
+
+    FQPSubmissionRing<Submission> ring(4096);
+    std::atomic<bool> drainScheduled(false);
+    std::atomic<long> consumed(0);
+    std::atomic<long> wakeups(0);
+    long total = static_cast<long>(producers) * SubmissionsPerProducer;
+
+    auto drain = [&]() {
+        wakeups++;
+        drainScheduled.store(false);
+        Submission submission;
+        while (ring.TryPop(submission)) {
+            consumed++;
+        }
+    };
+    auto scheduleDrain = [&]() {
+        if (!drainScheduled.exchange(true)) {
+            QMetaObject::invokeMethod(context, drain, Qt::QueuedConnection);
+        }
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<std::thread> threads;
+    for (int p = 0 ; p < producers ; ++p) {
+        threads.emplace_back([&]() {
+                for (int i = 0 ; i < SubmissionsPerProducer ; ++i) {
+                    Submission submission = std::make_shared<int>(i);
+                    while (!ring.TryPush(submission)) {
+                        // Full. Make sure the consumer is coming.
+                        scheduleDrain();
+                        QThread::yieldCurrentThread();
+                    }
+                    scheduleDrain();
+                }
+            });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    while (consumed.load() < total) {
+        QThread::yieldCurrentThread();
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+
+    consumerThread.quit();
+    consumerThread.wait();
+    delete context;
+    return _Result("ring", producers, total, nsecs, wakeups.load());
+}
+
+int
+main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const int producerCounts[] = { 1, 2, 4, 8 };
+    for (int producers : producerCounts) {
+        QJsonObject results[] = { _RunPost(producers), _RunRing(producers) };
+        for (const QJsonObject& result : results) {
+            std::printf("%s\n", QJsonDocument(result)
+                        .toJson(QJsonDocument::Compact).constData());
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
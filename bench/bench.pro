@@ -0,0 +1,11 @@
+#-------------------------------------------------
+#
+# Benchmarks. Build from FQPClientAll.pro, so the library is built first.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    SubmissionBench \
+    FQPClientBench \
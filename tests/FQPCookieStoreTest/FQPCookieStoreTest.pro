@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Tests for FQPFileCookieStore, and what FQPCookieJar saves to a store.
+#
+#-------------------------------------------------
+
+QT       += network testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = FQPCookieStoreTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+# The library is built by FQPClientAll.pro, two levels up from us. On macOS,
+# FQPClient.pro builds it as a framework.
+macx {
+    LIBS += -F$$OUT_PWD/../.. -framework FQPClient
+} else {
+    LIBS += -L$$OUT_PWD/../.. -lFQPClient
+}
+unix:QMAKE_RPATHDIR += $$OUT_PWD/../..
+
+SOURCES += \
+    tst_FQPCookieStore.cpp \
@@ -0,0 +1,209 @@
+// Saves cookies to a file and loads them back, and checks which cookies (and
+// how often) FQPCookieJar hands to its store.
+
+#include "FQPCookieJar.h"
+#include "FQPCookieStore.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// Remembers what it's given, instead of writing it anywhere.
+class CountingCookieStore : public FQPCookieStore
+{
+public:
+    CountingCookieStore() : saves(0) {}
+
+    virtual QList<QNetworkCookie> Load() override { return cookies; }
+    virtual void Save(const QList<QNetworkCookie>& saved) override {
+        cookies = saved;
+        saves++;
+    }
+
+    QList<QNetworkCookie> cookies;
+    int saves;
+};
+
+class FQPCookieStoreTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const QUrl _Url;
+
+    // Whole seconds, since that's all a Set-Cookie line keeps.
+    static QDateTime _InDays(int days) {
+        QDateTime expiry = QDateTime::currentDateTimeUtc().addDays(days);
+        expiry.setTime(QTime(expiry.time().hour(), expiry.time().minute(),
+                             expiry.time().second()));
+        return expiry;
+    }
+    static QNetworkCookie _Cookie(const QByteArray& name,
+                                  const QByteArray& value,
+                                  const QDateTime& expiry) {
+        QNetworkCookie cookie(name, value);
+        // With the leading dot, which the jar adds to a Domain attribute.
+        cookie.setDomain(".example.com");
+        cookie.setPath("/");
+        cookie.setExpirationDate(expiry);
+        return cookie;
+    }
+    static QByteArray _Value(const FQPCookieJar& jar, const QByteArray& name) {
+        return jar.GetCookieValue(name, _Url);
+    }
+
+    QTemporaryDir _dir;
+    QString _path;
+
+private slots:
+    void init();
+    void loadWithoutFile();
+    void roundTrip();
+    void jarDropsExpiredAndSessionCookies();
+    void jarLoadsOnlyLiveCookies();
+    void jarSavesOnlyChanges();
+    void jarSavesNewValue();
+    void jarSavesDeletion();
+};
+
+const QUrl FQPCookieStoreTest::_Url("https://example.com/api/");
+
+void
+FQPCookieStoreTest::init()
+{
+    QVERIFY(_dir.isValid());
+    _path = _dir.path() + "/" + QTest::currentTestFunction() + ".cookies";
+}
+
+void
+FQPCookieStoreTest::loadWithoutFile()
+{
+    FQPFileCookieStore store(_path);
+    QVERIFY(store.Load().isEmpty());
+}
+
+void
+FQPCookieStoreTest::roundTrip()
+{
+    QNetworkCookie token = _Cookie("csrftoken", "abc123", _InDays(365));
+    QNetworkCookie session = _Cookie("sessionid", "s3cr3t", _InDays(14));
+    session.setSecure(true);
+    session.setHttpOnly(true);
+    session.setPath("/api");
+    {
+        FQPFileCookieStore store(_path);
+        store.Save(QList<QNetworkCookie>() << token << session);
+    }
+    FQPFileCookieStore store(_path);
+    QList<QNetworkCookie> loaded = store.Load();
+    QCOMPARE(loaded.size(), 2);
+    QCOMPARE(loaded.at(0), token);
+    QCOMPARE(loaded.at(1), session);
+}
+
+void
+FQPCookieStoreTest::jarDropsExpiredAndSessionCookies()
+{
+    FQPCookieStoreSharedPtr store(new FQPFileCookieStore(_path));
+    {
+        FQPCookieJar jar(store);
+        jar.setCookiesFromUrl(
+            QList<QNetworkCookie>()
+            << _Cookie("kept", "1", _InDays(30))
+            << QNetworkCookie("session", "2")
+            << _Cookie("expired", "3", _InDays(-1)),
+            _Url);
+        // The session cookie is still good for this run.
+        QCOMPARE(_Value(jar, "session"), QByteArray("2"));
+    }
+    QList<QNetworkCookie> loaded = store->Load();
+    QCOMPARE(loaded.size(), 1);
+    QCOMPARE(loaded.at(0).name(), QByteArray("kept"));
+
+    FQPCookieJar jar(store);
+    QCOMPARE(_Value(jar, "kept"), QByteArray("1"));
+    QVERIFY(_Value(jar, "session").isEmpty());
+    QVERIFY(_Value(jar, "expired").isEmpty());
+}
+
+void
+FQPCookieStoreTest::jarLoadsOnlyLiveCookies()
+{
+    {
+        // Written by hand, as if they'd expired since, or an older version
+        // had saved a session cookie.
+        QFile file(_path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(_Cookie("live", "1", _InDays(30)).toRawForm() + "\n");
+        file.write(_Cookie("expired", "2", _InDays(-1)).toRawForm() + "\n");
+        QNetworkCookie session("session", "3");
+        session.setDomain(".example.com");
+        file.write(session.toRawForm() + "\n");
+    }
+    FQPCookieJar jar(FQPCookieStoreSharedPtr(new FQPFileCookieStore(_path)));
+    QCOMPARE(_Value(jar, "live"), QByteArray("1"));
+    QVERIFY(_Value(jar, "expired").isEmpty());
+    QVERIFY(_Value(jar, "session").isEmpty());
+}
+
+void
+FQPCookieStoreTest::jarSavesOnlyChanges()
+{
+    std::shared_ptr<CountingCookieStore> store(new CountingCookieStore());
+    FQPCookieJar jar(store);
+    QNetworkCookie token = _Cookie("csrftoken", "abc123", _InDays(365));
+    jar.setCookiesFromUrl(QList<QNetworkCookie>() << token, _Url);
+    QCOMPARE(store->saves, 1);
+
+    // The same token again, the way Django sends it on every response that
+    // uses it, with the expiry a little later each time.
+    jar.setCookiesFromUrl(QList<QNetworkCookie>() << token, _Url);
+    token.setExpirationDate(token.expirationDate().addSecs(60));
+    jar.setCookiesFromUrl(QList<QNetworkCookie>() << token, _Url);
+    // Session cookies never get saved, so they don't change anything either.
+    jar.setCookiesFromUrl(QList<QNetworkCookie>()
+                          << QNetworkCookie("session", "1"), _Url);
+    QCOMPARE(store->saves, 1);
+
+    // Pushed back far enough that the saved one would expire much too soon.
+    token.setExpirationDate(token.expirationDate().addDays(100));
+    jar.setCookiesFromUrl(QList<QNetworkCookie>() << token, _Url);
+    QCOMPARE(store->saves, 2);
+    QCOMPARE(store->cookies.at(0).expirationDate(), token.expirationDate());
+}
+
+void
+FQPCookieStoreTest::jarSavesNewValue()
+{
+    std::shared_ptr<CountingCookieStore> store(new CountingCookieStore());
+    store->cookies << _Cookie("csrftoken", "abc123", _InDays(365));
+    FQPCookieJar jar(store);
+    // Loading what's already saved doesn't need a save.
+    jar.setCookiesFromUrl(QList<QNetworkCookie>() << store->cookies.at(0),
+                          _Url);
+    QCOMPARE(store->saves, 0);
+
+    jar.setCookiesFromUrl(QList<QNetworkCookie>()
+                          << _Cookie("csrftoken", "rotated", _InDays(365)),
+                          _Url);
+    QCOMPARE(store->saves, 1);
+    QCOMPARE(store->cookies.size(), 1);
+    QCOMPARE(store->cookies.at(0).value(), QByteArray("rotated"));
+}
+
+void
+FQPCookieStoreTest::jarSavesDeletion()
+{
+    std::shared_ptr<CountingCookieStore> store(new CountingCookieStore());
+    QNetworkCookie token = _Cookie("csrftoken", "abc123", _InDays(365));
+    store->cookies << token;
+    FQPCookieJar jar(store);
+    QVERIFY(jar.deleteCookie(token));
+    QCOMPARE(store->saves, 1);
+    QVERIFY(store->cookies.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(FQPCookieStoreTest)
+
+#include "tst_FQPCookieStore.moc"
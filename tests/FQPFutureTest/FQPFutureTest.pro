@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Tests for the FQPWhenAll and FQPWhenAny combinators.
+#
+#-------------------------------------------------
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = FQPFutureTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# FQPFuture.h is all templates, so we don't need the library.
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_FQPFuture.cpp \
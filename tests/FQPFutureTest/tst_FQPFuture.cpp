@@ -0,0 +1,229 @@
+// Finishes and cancels futures by hand, through QFutureInterface (the way the
+// client does for its requests), and checks what FQPWhenAll and FQPWhenAny
+// make of them. The combinators watch from this thread, so the checks spin
+// the event loop with QTRY_*.
+
+#include "FQPFuture.h"
+
+#include <QtTest>
+
+class FQPFutureTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    template <typename T>
+    static QFutureInterface<T> _Started() {
+        QFutureInterface<T> promise;
+        promise.reportStarted();
+        return promise;
+    }
+    static void _Succeed(QFutureInterface<int>& promise, int value) {
+        promise.reportResult(value);
+        promise.reportFinished();
+    }
+    static void _Succeed(QFutureInterface<void>& promise) {
+        promise.reportFinished();
+    }
+    template <typename T>
+    static void _Cancel(QFutureInterface<T>& promise) {
+        promise.reportCanceled();
+        promise.reportFinished();
+    }
+
+private slots:
+    void whenAllSucceeds();
+    void whenAllAlreadyFinished();
+    void whenAllOneCanceled();
+    void whenAllAllCanceled();
+    void whenAllEmpty();
+    void whenAllVoidSucceeds();
+    void whenAllVoidOneCanceled();
+    void whenAllVoidAllCanceled();
+    void whenAllVoidEmpty();
+    void whenAnyFirstWins();
+    void whenAnyOneCanceled();
+    void whenAnyAllCanceled();
+    void whenAnyEmpty();
+};
+
+void
+FQPFutureTest::whenAllSucceeds()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFutureInterface<int> c = _Started<int>();
+    QFuture<QList<int> > all =
+        FQPWhenAll(QList<QFuture<int> >() << a.future() << b.future()
+                   << c.future());
+    // Out of order, but the results still come in the order of the futures.
+    _Succeed(c, 3);
+    _Succeed(a, 1);
+    QTest::qWait(10);
+    QVERIFY(!all.isFinished());
+    _Succeed(b, 2);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(!all.isCanceled());
+    QCOMPARE(all.result(), QList<int>() << 1 << 2 << 3);
+}
+
+void
+FQPFutureTest::whenAllAlreadyFinished()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    _Succeed(a, 1);
+    _Succeed(b, 2);
+    QFuture<QList<int> > all =
+        FQPWhenAll(QList<QFuture<int> >() << a.future() << b.future());
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(!all.isCanceled());
+    QCOMPARE(all.result(), QList<int>() << 1 << 2);
+}
+
+void
+FQPFutureTest::whenAllOneCanceled()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFuture<QList<int> > all =
+        FQPWhenAll(QList<QFuture<int> >() << a.future() << b.future());
+    _Cancel(a);
+    // Still waits for the rest.
+    QTest::qWait(10);
+    QVERIFY(!all.isFinished());
+    _Succeed(b, 2);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAllAllCanceled()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFuture<QList<int> > all =
+        FQPWhenAll(QList<QFuture<int> >() << a.future() << b.future());
+    _Cancel(a);
+    _Cancel(b);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAllEmpty()
+{
+    QFuture<QList<int> > all = FQPWhenAll(QList<QFuture<int> >());
+    QVERIFY(all.isFinished());
+    QVERIFY(!all.isCanceled());
+    QCOMPARE(all.result(), QList<int>());
+}
+
+void
+FQPFutureTest::whenAllVoidSucceeds()
+{
+    QFutureInterface<void> a = _Started<void>();
+    QFutureInterface<void> b = _Started<void>();
+    QFuture<void> all =
+        FQPWhenAll(QList<QFuture<void> >() << a.future() << b.future());
+    _Succeed(b);
+    QTest::qWait(10);
+    QVERIFY(!all.isFinished());
+    _Succeed(a);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(!all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAllVoidOneCanceled()
+{
+    QFutureInterface<void> a = _Started<void>();
+    QFutureInterface<void> b = _Started<void>();
+    QFuture<void> all =
+        FQPWhenAll(QList<QFuture<void> >() << a.future() << b.future());
+    _Succeed(a);
+    _Cancel(b);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAllVoidAllCanceled()
+{
+    QFutureInterface<void> a = _Started<void>();
+    QFutureInterface<void> b = _Started<void>();
+    QFuture<void> all =
+        FQPWhenAll(QList<QFuture<void> >() << a.future() << b.future());
+    _Cancel(a);
+    _Cancel(b);
+    QTRY_VERIFY(all.isFinished());
+    QVERIFY(all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAllVoidEmpty()
+{
+    QFuture<void> all = FQPWhenAll(QList<QFuture<void> >());
+    QVERIFY(all.isFinished());
+    QVERIFY(!all.isCanceled());
+}
+
+void
+FQPFutureTest::whenAnyFirstWins()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFuture<int> any =
+        FQPWhenAny(QList<QFuture<int> >() << a.future() << b.future());
+    _Succeed(b, 2);
+    QTRY_VERIFY(any.isFinished());
+    QVERIFY(!any.isCanceled());
+    QCOMPARE(any.result(), 2);
+    // The one that finishes later doesn't change it.
+    _Succeed(a, 1);
+    QTest::qWait(10);
+    QCOMPARE(any.result(), 2);
+    QCOMPARE(any.resultCount(), 1);
+}
+
+void
+FQPFutureTest::whenAnyOneCanceled()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFuture<int> any =
+        FQPWhenAny(QList<QFuture<int> >() << a.future() << b.future());
+    _Cancel(a);
+    // A cancellation isn't an answer, so it keeps waiting.
+    QTest::qWait(10);
+    QVERIFY(!any.isFinished());
+    _Succeed(b, 2);
+    QTRY_VERIFY(any.isFinished());
+    QVERIFY(!any.isCanceled());
+    QCOMPARE(any.result(), 2);
+}
+
+void
+FQPFutureTest::whenAnyAllCanceled()
+{
+    QFutureInterface<int> a = _Started<int>();
+    QFutureInterface<int> b = _Started<int>();
+    QFuture<int> any =
+        FQPWhenAny(QList<QFuture<int> >() << a.future() << b.future());
+    _Cancel(a);
+    _Cancel(b);
+    QTRY_VERIFY(any.isFinished());
+    QVERIFY(any.isCanceled());
+}
+
+void
+FQPFutureTest::whenAnyEmpty()
+{
+    QFuture<int> any = FQPWhenAny(QList<QFuture<int> >());
+    QVERIFY(any.isFinished());
+    QVERIFY(any.isCanceled());
+}
+
+QTEST_GUILESS_MAIN(FQPFutureTest)
+
+#include "tst_FQPFuture.moc"
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Conformance tests for the RFC 6902 JSON Patch and RFC 7386 merge patch
+# implementations.
+#
+#-------------------------------------------------
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = FQPJsonPatchTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+# The library is built by FQPClientAll.pro, two levels up from us. On macOS,
+# FQPClient.pro builds it as a framework.
+macx {
+    LIBS += -F$$OUT_PWD/../.. -framework FQPClient
+} else {
+    LIBS += -L$$OUT_PWD/../.. -lFQPClient
+}
+unix:QMAKE_RPATHDIR += $$OUT_PWD/../..
+
+SOURCES += \
+    tst_FQPJsonPatch.cpp \
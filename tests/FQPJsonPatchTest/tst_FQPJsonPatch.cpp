@@ -0,0 +1,287 @@
+// Conformance cases for FQPJson_ApplyPatch (RFC 6902) and
+// FQPJson_ApplyMergePatch (RFC 7386), mostly from the RFCs' own examples.
+
+#include "FQPJsonPatch.h"
+
+#include <QJsonDocument>
+#include <QtTest>
+
+// Any JSON value, scalars included (QJsonDocument only takes objects and
+// arrays).
+static QJsonValue
+_Json(const QByteArray& text)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson("[" + text + "]", &error);
+    if (doc.isNull()) {
+        qFatal("Bad JSON in test: %s", text.constData());
+    }
+    return doc.array().at(0);
+}
+
+static QByteArray
+_Dump(const QJsonValue& value)
+{
+    QByteArray text = QJsonDocument(QJsonArray() << value)
+        .toJson(QJsonDocument::Compact);
+    // Drop the "[" and "]" we wrapped it in.
+    return text.mid(1, text.size() - 2);
+}
+
+class FQPJsonPatchTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void applyPatch_data();
+    void applyPatch();
+    void failedPatchLeavesTargetAlone();
+    void mergePatch_data();
+    void mergePatch();
+};
+
+void
+FQPJsonPatchTest::applyPatch_data()
+{
+    QTest::addColumn<QByteArray>("document");
+    QTest::addColumn<QByteArray>("patch");
+    // The document afterwards. Ignored if the patch shouldn't apply.
+    QTest::addColumn<QByteArray>("expected");
+    QTest::addColumn<bool>("applies");
+
+    QTest::newRow("add member")
+        << QByteArray("{\"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/baz\", \"value\": \"qux\"}]")
+        << QByteArray("{\"baz\": \"qux\", \"foo\": \"bar\"}") << true;
+    QTest::newRow("add replaces member")
+        << QByteArray("{\"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/foo\", \"value\": 1}]")
+        << QByteArray("{\"foo\": 1}") << true;
+    QTest::newRow("add array element")
+        << QByteArray("{\"foo\": [\"bar\", \"baz\"]}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/foo/1\", \"value\": \"qux\"}]")
+        << QByteArray("{\"foo\": [\"bar\", \"qux\", \"baz\"]}") << true;
+    QTest::newRow("add at the end by index")
+        << QByteArray("[1, 2]")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/2\", \"value\": 3}]")
+        << QByteArray("[1, 2, 3]") << true;
+    QTest::newRow("add with -")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/foo/-\", \"value\": [3]}]")
+        << QByteArray("{\"foo\": [1, 2, [3]]}") << true;
+    QTest::newRow("add past the end")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/foo/3\", \"value\": 3}]")
+        << QByteArray() << false;
+    QTest::newRow("add without a parent")
+        << QByteArray("{\"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/baz/bat\", \"value\": 1}]")
+        << QByteArray() << false;
+    QTest::newRow("add the whole document")
+        << QByteArray("{\"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"\", \"value\": [1]}]")
+        << QByteArray("[1]") << true;
+    QTest::newRow("add without a value")
+        << QByteArray("{}")
+        << QByteArray("[{\"op\": \"add\", \"path\": \"/a\"}]")
+        << QByteArray() << false;
+
+    QTest::newRow("leading zero")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"replace\", \"path\": \"/foo/01\", \"value\": 3}]")
+        << QByteArray() << false;
+    QTest::newRow("signed index")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"replace\", \"path\": \"/foo/+1\", \"value\": 3}]")
+        << QByteArray() << false;
+    QTest::newRow("index zero")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"replace\", \"path\": \"/foo/0\", \"value\": 3}]")
+        << QByteArray("{\"foo\": [3, 2]}") << true;
+    QTest::newRow("- only for add")
+        << QByteArray("{\"foo\": [1, 2]}")
+        << QByteArray("[{\"op\": \"remove\", \"path\": \"/foo/-\"}]")
+        << QByteArray() << false;
+
+    QTest::newRow("remove member")
+        << QByteArray("{\"baz\": \"qux\", \"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"remove\", \"path\": \"/baz\"}]")
+        << QByteArray("{\"foo\": \"bar\"}") << true;
+    QTest::newRow("remove array element")
+        << QByteArray("{\"foo\": [\"bar\", \"qux\", \"baz\"]}")
+        << QByteArray("[{\"op\": \"remove\", \"path\": \"/foo/1\"}]")
+        << QByteArray("{\"foo\": [\"bar\", \"baz\"]}") << true;
+    QTest::newRow("remove missing")
+        << QByteArray("{\"foo\": 1}")
+        << QByteArray("[{\"op\": \"remove\", \"path\": \"/bar\"}]")
+        << QByteArray() << false;
+    QTest::newRow("replace")
+        << QByteArray("{\"baz\": \"qux\", \"foo\": \"bar\"}")
+        << QByteArray("[{\"op\": \"replace\", \"path\": \"/baz\", \"value\": \"boo\"}]")
+        << QByteArray("{\"baz\": \"boo\", \"foo\": \"bar\"}") << true;
+    QTest::newRow("replace missing")
+        << QByteArray("{\"foo\": 1}")
+        << QByteArray("[{\"op\": \"replace\", \"path\": \"/bar\", \"value\": 2}]")
+        << QByteArray() << false;
+
+    QTest::newRow("move member")
+        << QByteArray("{\"foo\": {\"bar\": \"baz\", \"waldo\": \"fred\"},"
+                      " \"qux\": {\"corge\": \"grault\"}}")
+        << QByteArray("[{\"op\": \"move\", \"from\": \"/foo/waldo\","
+                      " \"path\": \"/qux/thud\"}]")
+        << QByteArray("{\"foo\": {\"bar\": \"baz\"},"
+                      " \"qux\": {\"corge\": \"grault\", \"thud\": \"fred\"}}")
+        << true;
+    QTest::newRow("move array element")
+        << QByteArray("{\"foo\": [\"all\", \"grass\", \"cows\", \"eat\"]}")
+        << QByteArray("[{\"op\": \"move\", \"from\": \"/foo/1\", \"path\": \"/foo/3\"}]")
+        << QByteArray("{\"foo\": [\"all\", \"cows\", \"eat\", \"grass\"]}") << true;
+    QTest::newRow("move into itself")
+        << QByteArray("{\"a\": {\"b\": 1}}")
+        << QByteArray("[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a/c\"}]")
+        << QByteArray() << false;
+    QTest::newRow("move to the same place")
+        << QByteArray("{\"a\": {\"b\": 1}}")
+        << QByteArray("[{\"op\": \"move\", \"from\": \"/a\", \"path\": \"/a\"}]")
+        << QByteArray("{\"a\": {\"b\": 1}}") << true;
+    QTest::newRow("copy")
+        << QByteArray("{\"a\": {\"b\": 1}}")
+        << QByteArray("[{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"/a/c\"}]")
+        << QByteArray("{\"a\": {\"b\": 1, \"c\": {\"b\": 1}}}") << true;
+    QTest::newRow("copy missing")
+        << QByteArray("{\"a\": 1}")
+        << QByteArray("[{\"op\": \"copy\", \"from\": \"/b\", \"path\": \"/c\"}]")
+        << QByteArray() << false;
+
+    QTest::newRow("test passes")
+        << QByteArray("{\"baz\": \"qux\", \"foo\": [\"a\", 2, \"c\"]}")
+        << QByteArray("[{\"op\": \"test\", \"path\": \"/baz\", \"value\": \"qux\"},"
+                      " {\"op\": \"test\", \"path\": \"/foo/1\", \"value\": 2}]")
+        << QByteArray("{\"baz\": \"qux\", \"foo\": [\"a\", 2, \"c\"]}") << true;
+    QTest::newRow("test fails")
+        << QByteArray("{\"baz\": \"qux\"}")
+        << QByteArray("[{\"op\": \"test\", \"path\": \"/baz\", \"value\": \"bar\"}]")
+        << QByteArray() << false;
+    QTest::newRow("test compares deeply")
+        << QByteArray("{\"a\": {\"b\": [1, {\"c\": null}]}}")
+        << QByteArray("[{\"op\": \"test\", \"path\": \"/a\","
+                      " \"value\": {\"b\": [1, {\"c\": null}]}}]")
+        << QByteArray("{\"a\": {\"b\": [1, {\"c\": null}]}}") << true;
+
+    QTest::newRow("escaped pointers")
+        << QByteArray("{\"a/b\": 1, \"m~n\": 2}")
+        << QByteArray("[{\"op\": \"test\", \"path\": \"/a~1b\", \"value\": 1},"
+                      " {\"op\": \"replace\", \"path\": \"/m~0n\", \"value\": 3}]")
+        << QByteArray("{\"a/b\": 1, \"m~n\": 3}") << true;
+    QTest::newRow("pointer without a slash")
+        << QByteArray("{\"a\": 1}")
+        << QByteArray("[{\"op\": \"remove\", \"path\": \"a\"}]")
+        << QByteArray() << false;
+    QTest::newRow("unknown op")
+        << QByteArray("{\"a\": 1}")
+        << QByteArray("[{\"op\": \"frobnicate\", \"path\": \"/a\"}]")
+        << QByteArray() << false;
+}
+
+void
+FQPJsonPatchTest::applyPatch()
+{
+    QFETCH(QByteArray, document);
+    QFETCH(QByteArray, patch);
+    QFETCH(QByteArray, expected);
+    QFETCH(bool, applies);
+
+    QJsonValue target = _Json(document);
+    bool applied = FQPJson_ApplyPatch(target, _Json(patch).toArray());
+    QCOMPARE(applied, applies);
+    if (applies) {
+        QCOMPARE(_Dump(target), _Dump(_Json(expected)));
+    } else {
+        QCOMPARE(_Dump(target), _Dump(_Json(document)));
+    }
+}
+
+void
+FQPJsonPatchTest::failedPatchLeavesTargetAlone()
+{
+    // The first operations apply, and the last doesn't.
+    QJsonValue target = _Json("{\"a\": [1, 2], \"b\": {\"c\": 3}}");
+    QJsonValue before = target;
+    QJsonArray patch = _Json("[{\"op\": \"add\", \"path\": \"/a/-\", \"value\": 3},"
+                             " {\"op\": \"remove\", \"path\": \"/b/c\"},"
+                             " {\"op\": \"test\", \"path\": \"/a/0\", \"value\": 9}]")
+        .toArray();
+    QVERIFY(!FQPJson_ApplyPatch(target, patch));
+    QCOMPARE(_Dump(target), _Dump(before));
+}
+
+void
+FQPJsonPatchTest::mergePatch_data()
+{
+    QTest::addColumn<QByteArray>("document");
+    QTest::addColumn<QByteArray>("patch");
+    QTest::addColumn<QByteArray>("expected");
+
+    // RFC 7386, Appendix A.
+    QTest::newRow("A.1") << QByteArray("{\"a\": \"b\"}")
+                         << QByteArray("{\"a\": \"c\"}")
+                         << QByteArray("{\"a\": \"c\"}");
+    QTest::newRow("A.2") << QByteArray("{\"a\": \"b\"}")
+                         << QByteArray("{\"b\": \"c\"}")
+                         << QByteArray("{\"a\": \"b\", \"b\": \"c\"}");
+    QTest::newRow("A.3") << QByteArray("{\"a\": \"b\"}")
+                         << QByteArray("{\"a\": null}")
+                         << QByteArray("{}");
+    QTest::newRow("A.4") << QByteArray("{\"a\": \"b\", \"b\": \"c\"}")
+                         << QByteArray("{\"a\": null}")
+                         << QByteArray("{\"b\": \"c\"}");
+    QTest::newRow("A.5") << QByteArray("{\"a\": [\"b\"]}")
+                         << QByteArray("{\"a\": \"c\"}")
+                         << QByteArray("{\"a\": \"c\"}");
+    QTest::newRow("A.6") << QByteArray("{\"a\": \"c\"}")
+                         << QByteArray("{\"a\": [\"b\"]}")
+                         << QByteArray("{\"a\": [\"b\"]}");
+    QTest::newRow("A.7") << QByteArray("{\"a\": {\"b\": \"c\"}}")
+                         << QByteArray("{\"a\": {\"b\": \"d\", \"c\": null}}")
+                         << QByteArray("{\"a\": {\"b\": \"d\"}}");
+    QTest::newRow("A.8") << QByteArray("{\"a\": [{\"b\": \"c\"}]}")
+                         << QByteArray("{\"a\": [1]}")
+                         << QByteArray("{\"a\": [1]}");
+    QTest::newRow("A.9") << QByteArray("[\"a\", \"b\"]")
+                         << QByteArray("[\"c\", \"d\"]")
+                         << QByteArray("[\"c\", \"d\"]");
+    QTest::newRow("A.10") << QByteArray("{\"a\": \"b\"}")
+                          << QByteArray("[\"c\"]")
+                          << QByteArray("[\"c\"]");
+    QTest::newRow("A.11") << QByteArray("{\"a\": \"foo\"}")
+                          << QByteArray("null")
+                          << QByteArray("null");
+    QTest::newRow("A.12") << QByteArray("{\"a\": \"foo\"}")
+                          << QByteArray("\"bar\"")
+                          << QByteArray("\"bar\"");
+    QTest::newRow("A.13") << QByteArray("{\"e\": null}")
+                          << QByteArray("{\"a\": 1}")
+                          << QByteArray("{\"a\": 1, \"e\": null}");
+    QTest::newRow("A.14") << QByteArray("[1, 2]")
+                          << QByteArray("{\"a\": \"b\", \"c\": null}")
+                          << QByteArray("{\"a\": \"b\"}");
+    QTest::newRow("A.15") << QByteArray("{}")
+                          << QByteArray("{\"a\": {\"bb\": {\"ccc\": null}}}")
+                          << QByteArray("{\"a\": {\"bb\": {}}}");
+}
+
+void
+FQPJsonPatchTest::mergePatch()
+{
+    QFETCH(QByteArray, document);
+    QFETCH(QByteArray, patch);
+    QFETCH(QByteArray, expected);
+
+    QJsonValue target = _Json(document);
+    FQPJson_ApplyMergePatch(target, _Json(patch));
+    QCOMPARE(_Dump(target), _Dump(_Json(expected)));
+}
+
+QTEST_GUILESS_MAIN(FQPJsonPatchTest)
+
+#include "tst_FQPJsonPatch.moc"
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Tests for FQPMemoryBudget's accounting and wake-ups.
+#
+#-------------------------------------------------
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = FQPMemoryBudgetTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+# The library is built by FQPClientAll.pro, two levels up from us. On macOS,
+# FQPClient.pro builds it as a framework.
+macx {
+    LIBS += -F$$OUT_PWD/../.. -framework FQPClient
+} else {
+    LIBS += -L$$OUT_PWD/../.. -lFQPClient
+}
+unix:QMAKE_RPATHDIR += $$OUT_PWD/../..
+
+SOURCES += \
+    tst_FQPMemoryBudget.cpp \
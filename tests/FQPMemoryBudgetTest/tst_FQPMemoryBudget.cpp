@@ -0,0 +1,92 @@
+// Checks the budget's accounting, and that everyone who stops reading is
+// woken again.
+
+#include "FQPMemoryBudget.h"
+
+#include <QSignalSpy>
+#include <QtTest>
+
+class FQPMemoryBudgetTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void reserveWithinBudget();
+    void noLimit();
+    void partialGrantIsWoken();
+    void deniedIsWoken();
+    void noWakeWithoutWaiters();
+    void overcommitWhenEveryoneIsPaused();
+};
+
+void
+FQPMemoryBudgetTest::reserveWithinBudget()
+{
+    FQPMemoryBudget budget(100, 0);
+    QCOMPARE(budget.Reserve(60, 0), qint64(60));
+    QCOMPARE(budget.GetInUse(), qint64(60));
+    budget.Release(60);
+    QCOMPARE(budget.GetInUse(), qint64(0));
+    QCOMPARE(budget.GetHighWaterMark(), qint64(60));
+}
+
+void
+FQPMemoryBudgetTest::noLimit()
+{
+    FQPMemoryBudget budget(0, 0);
+    QCOMPARE(budget.Reserve(1 << 20, 0), qint64(1 << 20));
+}
+
+void
+FQPMemoryBudgetTest::partialGrantIsWoken()
+{
+    FQPMemoryBudget budget(100, 0);
+    QSignalSpy released(&budget, &FQPMemoryBudget::Released);
+    QCOMPARE(budget.Reserve(80, 0), qint64(80));
+    // Only part of it, so the caller stops reading and waits for the rest.
+    QCOMPARE(budget.Reserve(50, 0), qint64(20));
+    budget.Pause(20);
+    QCOMPARE(released.count(), 0);
+    budget.Release(80);
+    QCOMPARE(released.count(), 1);
+}
+
+void
+FQPMemoryBudgetTest::deniedIsWoken()
+{
+    FQPMemoryBudget budget(100, 0);
+    QSignalSpy released(&budget, &FQPMemoryBudget::Released);
+    QCOMPARE(budget.Reserve(100, 0), qint64(100));
+    QCOMPARE(budget.Reserve(10, 0), qint64(0));
+    budget.Release(100);
+    QCOMPARE(released.count(), 1);
+}
+
+void
+FQPMemoryBudgetTest::noWakeWithoutWaiters()
+{
+    FQPMemoryBudget budget(100, 0);
+    QSignalSpy released(&budget, &FQPMemoryBudget::Released);
+    QCOMPARE(budget.Reserve(10, 0), qint64(10));
+    budget.Release(10);
+    QCOMPARE(released.count(), 0);
+}
+
+void
+FQPMemoryBudgetTest::overcommitWhenEveryoneIsPaused()
+{
+    FQPMemoryBudget budget(100, 0);
+    QSignalSpy released(&budget, &FQPMemoryBudget::Released);
+    QCOMPARE(budget.Reserve(100, 0), qint64(100));
+    // The only reader holding memory stops, so no one would ever release
+    // any. The next reader gets to go over the budget instead.
+    budget.Pause(100);
+    QCOMPARE(released.count(), 1);
+    QCOMPARE(budget.Reserve(10, 0), qint64(10));
+    QCOMPARE(budget.GetInUse(), qint64(110));
+    QCOMPARE(budget.GetPauseCount(), qint64(1));
+}
+
+QTEST_GUILESS_MAIN(FQPMemoryBudgetTest)
+
+#include "tst_FQPMemoryBudget.moc"
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Tests for how FQPReplyHandler follows redirects, and how FQPClient
+# remembers permanent ones, against the bench's mock server.
+#
+#-------------------------------------------------
+
+QT       += network testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = FQPRedirectTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../.. $$PWD/../../bench/FQPClientBench
+# The library is built by FQPClientAll.pro, two levels up from us. On macOS,
+# FQPClient.pro builds it as a framework.
+macx {
+    LIBS += -F$$OUT_PWD/../.. -framework FQPClient
+} else {
+    LIBS += -L$$OUT_PWD/../.. -lFQPClient
+}
+unix:QMAKE_RPATHDIR += $$OUT_PWD/../..
+
+SOURCES += \
+    tst_FQPRedirect.cpp \
+    $$PWD/../../bench/FQPClientBench/FQPMockServer.cpp \
+
+HEADERS += \
+    $$PWD/../../bench/FQPClientBench/FQPMockServer.h \
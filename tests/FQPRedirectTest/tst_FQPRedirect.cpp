@@ -0,0 +1,279 @@
+// Follows redirects from the mock server, and checks what reaches the other
+// end: the method and body for each status, the hop limit, the headers we
+// keep from other origins, https to http, and the permanent redirects the
+// client remembers.
+
+#include "FQPClient.h"
+#include "FQPCookieStore.h"
+#include "FQPMockServer.h"
+#include "FQPReplyHandler.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#ifndef QT_NO_SSL
+#include <QSslSocket>
+#endif
+
+// Hands the jar a CSRF token for the mock servers' host, so that we send it.
+class TokenCookieStore : public FQPCookieStore
+{
+public:
+    virtual QList<QNetworkCookie> Load() override {
+        QNetworkCookie cookie(FQPClient::CSRFCookieName, Token);
+        cookie.setDomain("127.0.0.1");
+        cookie.setPath("/");
+        cookie.setExpirationDate(QDateTime::currentDateTimeUtc().addDays(1));
+        return QList<QNetworkCookie>() << cookie;
+    }
+    virtual void Save(const QList<QNetworkCookie>& /*cookies*/) override {}
+
+    static const QByteArray Token;
+};
+
+const QByteArray TokenCookieStore::Token = "redirect-test-token";
+
+class FQPRedirectTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static FQPMockServerConfig _Config() {
+        FQPMockServerConfig config;
+        config.recordRequests = true;
+        return config;
+    }
+    // Where a redirect to path on server goes, for a Location header.
+    static QByteArray _Location(const FQPMockServer& server,
+                                const QByteArray& path) {
+        QUrl url = server.GetBaseUrl().resolved(QUrl(QString::fromUtf8(path)));
+        return url.toEncoded();
+    }
+    // Fetches command, and waits for its handler. Returns the error
+    // RequestFailed reported, if any.
+    static QNetworkReply::NetworkError _Fetch(FQPClient& client,
+                                              const QString& command,
+                                              const QByteArray& method) {
+        QNetworkReply::NetworkError error = QNetworkReply::NoError;
+        QMetaObject::Connection failed =
+            connect(&client, &FQPClient::RequestFailed,
+                    [&error](const QUrl&, QNetworkReply::NetworkError e) {
+                        error = e;
+                    });
+        bool done = false;
+        QJsonObject parameters;
+        parameters["value"] = 42;
+        client.Fetch(command, method, parameters, [&done]() { done = true; });
+        QElapsedTimer timer;
+        timer.start();
+        while (!done && (timer.elapsed() < 5000)) {
+            QTest::qWait(10);
+        }
+        disconnect(failed);
+        return done ? error : QNetworkReply::TimeoutError;
+    }
+
+private slots:
+    void methodAfterRedirect_data();
+    void methodAfterRedirect();
+    void tooManyRedirects();
+    void tokenAndKeyStayWithOrigin_data();
+    void tokenAndKeyStayWithOrigin();
+    void httpsToHttpIsRefused();
+    void permanentRedirectIsRemembered_data();
+    void permanentRedirectIsRemembered();
+};
+
+void
+FQPRedirectTest::methodAfterRedirect_data()
+{
+    QTest::addColumn<int>("status");
+    QTest::addColumn<QByteArray>("method");
+    QTest::addColumn<bool>("keepsBody");
+
+    QTest::newRow("301") << 301 << QByteArray("GET") << false;
+    QTest::newRow("302") << 302 << QByteArray("GET") << false;
+    QTest::newRow("303") << 303 << QByteArray("GET") << false;
+    QTest::newRow("307") << 307 << QByteArray("POST") << true;
+    QTest::newRow("308") << 308 << QByteArray("POST") << true;
+}
+
+void
+FQPRedirectTest::methodAfterRedirect()
+{
+    QFETCH(int, status);
+    QFETCH(QByteArray, method);
+    QFETCH(bool, keepsBody);
+
+    FQPMockServerConfig config = _Config();
+    config.redirects["/old/"] = FQPMockRedirect(status, "/new/");
+    FQPMockServer server(config);
+    server.Start();
+    FQPClient client(server.GetBaseUrl());
+
+    QCOMPARE(_Fetch(client, "old", "POST"), QNetworkReply::NoError);
+    QList<FQPMockRequest> requests = server.GetRequests();
+    QCOMPARE(requests.size(), 2);
+    QCOMPARE(requests[0].method, QByteArray("POST"));
+    QVERIFY(!requests[0].body.isEmpty());
+    QCOMPARE(requests[1].path, QByteArray("/new/"));
+    QCOMPARE(requests[1].method, method);
+    if (keepsBody) {
+        QCOMPARE(requests[1].body, requests[0].body);
+    } else {
+        QVERIFY(requests[1].body.isEmpty());
+    }
+}
+
+void
+FQPRedirectTest::tooManyRedirects()
+{
+    FQPMockServerConfig config = _Config();
+    config.redirects["/loop/"] = FQPMockRedirect(302, "/loop/");
+    FQPMockServer server(config);
+    server.Start();
+    FQPClient client(server.GetBaseUrl());
+
+    QCOMPARE(_Fetch(client, "loop", "GET"),
+             QNetworkReply::TooManyRedirectsError);
+    // The first request, and then as many redirects as we follow.
+    QCOMPARE(server.GetRequests().size(), FQPReplyHandler::MaxRedirects + 1);
+}
+
+void
+FQPRedirectTest::tokenAndKeyStayWithOrigin_data()
+{
+    QTest::addColumn<bool>("sameOrigin");
+
+    QTest::newRow("same origin") << true;
+    QTest::newRow("other origin") << false;
+}
+
+void
+FQPRedirectTest::tokenAndKeyStayWithOrigin()
+{
+    QFETCH(bool, sameOrigin);
+
+    // Another port, so another origin on the same host.
+    FQPMockServer other(_Config());
+    other.Start();
+    FQPMockServerConfig config = _Config();
+    config.redirects["/old/"] = FQPMockRedirect(
+        307, sameOrigin ? QByteArray("/new/") : _Location(other, "/new/"));
+    FQPMockServer origin(config);
+    origin.Start();
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    FQPClient client(origin.GetBaseUrl());
+    client.SetCookieStore(FQPCookieStoreSharedPtr(new TokenCookieStore()));
+    // So that mutating requests carry an idempotency key.
+    client.EnableRequestJournal(dir.filePath("journal"));
+
+    QCOMPARE(_Fetch(client, "old", "POST"), QNetworkReply::NoError);
+    QList<FQPMockRequest> sent = origin.GetRequests();
+    QVERIFY(!sent.isEmpty());
+    QCOMPARE(sent[0].headers.value("x-csrftoken"), TokenCookieStore::Token);
+    QByteArray key = sent[0].headers.value("idempotency-key");
+    QVERIFY(!key.isEmpty());
+
+    FQPMockServer& target = sameOrigin ? origin : other;
+    QList<FQPMockRequest> redirected = target.GetRequests();
+    QVERIFY(!redirected.isEmpty());
+    FQPMockRequest last = redirected.last();
+    QCOMPARE(last.path, QByteArray("/new/"));
+    if (sameOrigin) {
+        QCOMPARE(last.headers.value("x-csrftoken"), TokenCookieStore::Token);
+        QCOMPARE(last.headers.value("idempotency-key"), key);
+    } else {
+        QVERIFY(!last.headers.contains("x-csrftoken"));
+        QVERIFY(!last.headers.contains("idempotency-key"));
+    }
+}
+
+void
+FQPRedirectTest::httpsToHttpIsRefused()
+{
+#ifdef QT_NO_SSL
+    QSKIP("Qt was built without SSL");
+#else
+    if (!QSslSocket::supportsSsl()) {
+        QSKIP("No SSL library to serve https with");
+    }
+    // Self-signed, for 127.0.0.1. The reply handler ignores SSL errors.
+    QFile certificate(QFINDTESTDATA("localhost.crt"));
+    QFile key(QFINDTESTDATA("localhost.key"));
+    QVERIFY(certificate.open(QIODevice::ReadOnly));
+    QVERIFY(key.open(QIODevice::ReadOnly));
+
+    FQPMockServer plain(_Config());
+    plain.Start();
+    FQPMockServerConfig config = _Config();
+    config.tlsCertificate = certificate.readAll();
+    config.tlsKey = key.readAll();
+    config.redirects["/old/"] = FQPMockRedirect(302, _Location(plain, "/new/"));
+    FQPMockServer secure(config);
+    secure.Start();
+    QCOMPARE(secure.GetBaseUrl().scheme(), QString("https"));
+    FQPClient client(secure.GetBaseUrl());
+
+    QCOMPARE(_Fetch(client, "old", "GET"),
+             QNetworkReply::InsecureRedirectError);
+    QCOMPARE(secure.GetRequests().size(), 1);
+    QVERIFY(plain.GetRequests().isEmpty());
+#endif
+}
+
+void
+FQPRedirectTest::permanentRedirectIsRemembered_data()
+{
+    QTest::addColumn<int>("status");
+    QTest::addColumn<bool>("sameOrigin");
+    QTest::addColumn<bool>("remembered");
+
+    QTest::newRow("301") << 301 << true << true;
+    QTest::newRow("308") << 308 << true << true;
+    QTest::newRow("302") << 302 << true << false;
+    // It would get all of our later requests.
+    QTest::newRow("301 to other origin") << 301 << false << false;
+}
+
+void
+FQPRedirectTest::permanentRedirectIsRemembered()
+{
+    QFETCH(int, status);
+    QFETCH(bool, sameOrigin);
+    QFETCH(bool, remembered);
+
+    FQPMockServer other(_Config());
+    other.Start();
+    FQPMockServerConfig config = _Config();
+    config.redirects["/old/"] = FQPMockRedirect(
+        status, sameOrigin ? QByteArray("/new/") : _Location(other, "/new/"));
+    FQPMockServer origin(config);
+    origin.Start();
+    FQPClient client(origin.GetBaseUrl());
+
+    QCOMPARE(_Fetch(client, "old", "GET"), QNetworkReply::NoError);
+    origin.ClearRequests();
+    other.ClearRequests();
+
+    QCOMPARE(_Fetch(client, "old", "GET"), QNetworkReply::NoError);
+    QList<FQPMockRequest> requests = origin.GetRequests();
+    if (remembered) {
+        // Straight to the target, without asking the old one again.
+        QCOMPARE(requests.size(), 1);
+        QCOMPARE(requests[0].path, QByteArray("/new/"));
+    } else {
+        QVERIFY(!requests.isEmpty());
+        QCOMPARE(requests[0].path, QByteArray("/old/"));
+    }
+}
+
+QTEST_GUILESS_MAIN(FQPRedirectTest)
+
+#include "tst_FQPRedirect.moc"
@@ -0,0 +1,204 @@
+// Writes journals, reopens them the way the next run would, and checks what
+// comes back.
+
+#include "FQPRequestJournal.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+class FQPRequestJournalTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static FQPRequestJournal::Entry _Entry(const QByteArray& key) {
+        FQPRequestJournal::Entry entry;
+        entry.key = key;
+        entry.url = QUrl("https://example.com/api/" +
+                         QString::fromLatin1(key) + "/");
+        entry.method = "POST";
+        entry.content = "{\"name\":\"" + key + "\"}";
+        return entry;
+    }
+    static QList<QByteArray> _Keys(const FQPRequestJournal& journal) {
+        QList<QByteArray> keys;
+        foreach (const FQPRequestJournal::Entry& entry, journal.GetPending()) {
+            keys.append(entry.key);
+        }
+        return keys;
+    }
+    static QList<QByteArray> _Lines(const QString& path) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QList<QByteArray>();
+        }
+        return file.readAll().split('\n');
+    }
+
+    QTemporaryDir _dir;
+    QString _path;
+
+private slots:
+    void init();
+    void newJournalIsEmpty();
+    void reloadKeepsOrder();
+    void reloadSkipsDone();
+    void doneForUnknownKey();
+    void tornLastLine();
+    void appendAfterTornLastLine();
+    void compactionKeepsOnlyPending();
+    void noCompactionBelowThreshold();
+};
+
+void
+FQPRequestJournalTest::init()
+{
+    QVERIFY(_dir.isValid());
+    _path = _dir.path() + "/" + QTest::currentTestFunction() + ".journal";
+}
+
+void
+FQPRequestJournalTest::newJournalIsEmpty()
+{
+    FQPRequestJournal journal(_path);
+    QVERIFY(journal.IsEmpty());
+    QVERIFY(QFile::exists(_path));
+}
+
+void
+FQPRequestJournalTest::reloadKeepsOrder()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("a"));
+        journal.Append(_Entry("b"));
+        journal.Append(_Entry("c"));
+    }
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "a" << "b" << "c");
+    FQPRequestJournal::Entry entry = journal.GetPending().at(1);
+    FQPRequestJournal::Entry expected = _Entry("b");
+    QCOMPARE(entry.url, expected.url);
+    QCOMPARE(entry.method, expected.method);
+    QCOMPARE(entry.content, expected.content);
+}
+
+void
+FQPRequestJournalTest::reloadSkipsDone()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("a"));
+        journal.Append(_Entry("b"));
+        journal.Append(_Entry("c"));
+        journal.MarkDone("b");
+        QCOMPARE(_Keys(journal), QList<QByteArray>() << "a" << "c");
+    }
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "a" << "c");
+    QVERIFY(journal.Contains("a"));
+    QVERIFY(!journal.Contains("b"));
+}
+
+void
+FQPRequestJournalTest::doneForUnknownKey()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("a"));
+        journal.MarkDone("nope");
+    }
+    QCOMPARE(_Lines(_path).size(), 2);
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "a");
+}
+
+void
+FQPRequestJournalTest::tornLastLine()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("a"));
+        journal.Append(_Entry("b"));
+    }
+    {
+        // A crash part way through writing the next record.
+        QFile file(_path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+        file.write("{\"op\":\"add\",\"key\":\"c\",\"ur");
+    }
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "a" << "b");
+}
+
+void
+FQPRequestJournalTest::appendAfterTornLastLine()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("a"));
+    }
+    {
+        QFile file(_path);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+        file.write("{\"op\":\"done\",\"ke");
+    }
+    {
+        FQPRequestJournal journal(_path);
+        journal.Append(_Entry("b"));
+    }
+    // b starts a line of its own, rather than being lost with the torn one.
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "a" << "b");
+}
+
+void
+FQPRequestJournalTest::compactionKeepsOnlyPending()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.SetCompactionThreshold(2);
+        journal.Append(_Entry("a"));
+        journal.Append(_Entry("b"));
+        journal.Append(_Entry("c"));
+        journal.MarkDone("a");
+        journal.Sync();
+        QCOMPARE(_Lines(_path).size(), 5);
+        // Two done, which outnumber the one pending.
+        journal.MarkDone("b");
+        QCOMPARE(_Keys(journal), QList<QByteArray>() << "c");
+        // Still appends to the compacted file.
+        journal.Append(_Entry("d"));
+    }
+    QList<QByteArray> lines = _Lines(_path);
+    QCOMPARE(lines.size(), 3);
+    QVERIFY(lines.at(0).contains("\"key\":\"c\""));
+    QVERIFY(lines.at(1).contains("\"key\":\"d\""));
+    QVERIFY(lines.at(2).isEmpty());
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "c" << "d");
+}
+
+void
+FQPRequestJournalTest::noCompactionBelowThreshold()
+{
+    {
+        FQPRequestJournal journal(_path);
+        journal.SetCompactionThreshold(2);
+        journal.Append(_Entry("a"));
+        journal.Append(_Entry("b"));
+        journal.Append(_Entry("c"));
+        journal.Append(_Entry("d"));
+        journal.MarkDone("a");
+        // Two done, but no more than the two still pending.
+        journal.MarkDone("b");
+    }
+    QCOMPARE(_Lines(_path).size(), 7);
+    FQPRequestJournal journal(_path);
+    QCOMPARE(_Keys(journal), QList<QByteArray>() << "c" << "d");
+}
+
+QTEST_GUILESS_MAIN(FQPRequestJournalTest)
+
+#include "tst_FQPRequestJournal.moc"
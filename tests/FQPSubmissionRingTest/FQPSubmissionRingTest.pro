@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Tests for FQPSubmissionRing, including a stress run with many producer
+# threads.
+#
+#-------------------------------------------------
+
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase thread
+CONFIG -= app_bundle
+
+TARGET = FQPSubmissionRingTest
+TEMPLATE = app
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# FQPSubmissionRing.h is all templates, so we don't need the library.
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_FQPSubmissionRing.cpp \
@@ -0,0 +1,198 @@
+// Checks FQPSubmissionRing on one thread, then has many producer threads push
+// through a small ring (so it's full, and wraps, all the time) while this
+// thread pops, and checks that everything comes out once, and in order for
+// each producer.
+
+#include "FQPSubmissionRing.h"
+
+#include <QtTest>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class FQPSubmissionRingTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void pushPopInOrder();
+    void capacityRoundsUpToPowerOfTwo();
+    void fullUntilPopped();
+    void wrapsAround();
+    void popReleasesValue();
+    void isEmpty();
+    void manyProducers_data();
+    void manyProducers();
+};
+
+void
+FQPSubmissionRingTest::pushPopInOrder()
+{
+    FQPSubmissionRing<int> ring(8);
+    int value = -1;
+    QVERIFY(!ring.TryPop(value));
+    for (int i = 0 ; i < 5 ; ++i) {
+        QVERIFY(ring.TryPush(i));
+    }
+    for (int i = 0 ; i < 5 ; ++i) {
+        QVERIFY(ring.TryPop(value));
+        QCOMPARE(value, i);
+    }
+    QVERIFY(!ring.TryPop(value));
+}
+
+void
+FQPSubmissionRingTest::capacityRoundsUpToPowerOfTwo()
+{
+    FQPSubmissionRing<int> ring(5);
+    for (int i = 0 ; i < 8 ; ++i) {
+        QVERIFY(ring.TryPush(i));
+    }
+    QVERIFY(!ring.TryPush(8));
+}
+
+void
+FQPSubmissionRingTest::fullUntilPopped()
+{
+    FQPSubmissionRing<int> ring(4);
+    for (int i = 0 ; i < 4 ; ++i) {
+        QVERIFY(ring.TryPush(i));
+    }
+    QVERIFY(!ring.TryPush(4));
+    int value = -1;
+    QVERIFY(ring.TryPop(value));
+    QCOMPARE(value, 0);
+    QVERIFY(ring.TryPush(4));
+    QVERIFY(!ring.TryPush(5));
+    for (int i = 1 ; i <= 4 ; ++i) {
+        QVERIFY(ring.TryPop(value));
+        QCOMPARE(value, i);
+    }
+}
+
+void
+FQPSubmissionRingTest::wrapsAround()
+{
+    FQPSubmissionRing<int> ring(4);
+    int value = -1;
+    // Many times around, never more than three in it.
+    for (int i = 0 ; i < 1000 ; ++i) {
+        QVERIFY(ring.TryPush(i));
+        if (i >= 2) {
+            QVERIFY(ring.TryPop(value));
+            QCOMPARE(value, i - 2);
+        }
+    }
+}
+
+void
+FQPSubmissionRingTest::popReleasesValue()
+{
+    FQPSubmissionRing<std::shared_ptr<int> > ring(4);
+    std::shared_ptr<int> pushed = std::make_shared<int>(42);
+    QVERIFY(ring.TryPush(pushed));
+    QCOMPARE(pushed.use_count(), 2L);
+    {
+        std::shared_ptr<int> popped;
+        QVERIFY(ring.TryPop(popped));
+        QCOMPARE(*popped, 42);
+    }
+    // The cell doesn't keep it until it's reused.
+    QCOMPARE(pushed.use_count(), 1L);
+}
+
+void
+FQPSubmissionRingTest::isEmpty()
+{
+    FQPSubmissionRing<int> ring(4);
+    QVERIFY(ring.IsEmpty());
+    QVERIFY(ring.TryPush(1));
+    QVERIFY(!ring.IsEmpty());
+    int value = -1;
+    QVERIFY(ring.TryPop(value));
+    QVERIFY(ring.IsEmpty());
+}
+
+void
+FQPSubmissionRingTest::manyProducers_data()
+{
+    QTest::addColumn<int>("producers");
+    QTest::addColumn<int>("capacity");
+
+    QTest::newRow("2 producers") << 2 << 16;
+    QTest::newRow("4 producers") << 4 << 16;
+    QTest::newRow("8 producers") << 8 << 64;
+    QTest::newRow("8 producers, tiny ring") << 8 << 2;
+}
+
+void
+FQPSubmissionRingTest::manyProducers()
+{
+    QFETCH(int, producers);
+    QFETCH(int, capacity);
+    const int perProducer = 100000;
+
+    // Each item is (producer, sequence), so we can check the order per
+    // producer.
+    typedef std::pair<int, int> Item;
+    FQPSubmissionRing<Item> ring(capacity);
+    std::atomic<bool> go(false);
+    // Set if we give up, so the producers don't wait for room forever.
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int p = 0 ; p < producers ; ++p) {
+        threads.emplace_back([&ring, &go, &stop, p, perProducer]() {
+                while (!go.load()) {
+                    std::this_thread::yield();
+                }
+                for (int i = 0 ; i < perProducer ; ++i) {
+                    while (!ring.TryPush(Item(p, i))) {
+                        if (stop.load()) {
+                            return;
+                        }
+                        std::this_thread::yield();
+                    }
+                }
+            });
+    }
+
+    std::vector<int> next(producers, 0);
+    long total = static_cast<long>(producers) * perProducer;
+    long popped = 0;
+    QString failure;
+    go.store(true);
+    Item item;
+    while (popped < total) {
+        if (!ring.TryPop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if ((item.first < 0) || (item.first >= producers)) {
+            failure = QString("no producer %1").arg(item.first);
+            break;
+        }
+        if (item.second != next[item.first]) {
+            failure = QString("producer %1 sent %2, expected %3")
+                .arg(item.first).arg(item.second).arg(next[item.first]);
+            break;
+        }
+        next[item.first]++;
+        popped++;
+    }
+    stop.store(true);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    QVERIFY2(failure.isEmpty(), qPrintable(failure));
+    for (int p = 0 ; p < producers ; ++p) {
+        QCOMPARE(next[p], perProducer);
+    }
+    QVERIFY(!ring.TryPop(item));
+    QVERIFY(ring.IsEmpty());
+}
+
+QTEST_GUILESS_MAIN(FQPSubmissionRingTest)
+
+#include "tst_FQPSubmissionRing.moc"
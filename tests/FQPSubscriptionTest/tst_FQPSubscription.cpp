@@ -0,0 +1,180 @@
+// Feeds bytes to FQPSubscription's parser the way the reply hands them over,
+// split at awkward places, and checks the events that come out.
+
+#include "FQPSubscription.h"
+
+#include <QSignalSpy>
+#include <QtTest>
+
+// Opens up the parsing, so we don't need a server.
+class TestSubscription : public FQPSubscription
+{
+public:
+    TestSubscription() :
+        FQPSubscription(QNetworkAccessManagerPtr(), QNetworkRequest()) {}
+
+    using FQPSubscription::_BeginStream;
+    using FQPSubscription::_Append;
+    using FQPSubscription::_EndStream;
+};
+
+class FQPSubscriptionTest : public QObject
+{
+    Q_OBJECT
+
+private:
+    static QByteArray _Type(const QSignalSpy& spy, int i) {
+        return spy.at(i).at(0).toByteArray();
+    }
+    static QByteArray _Id(const QSignalSpy& spy, int i) {
+        return spy.at(i).at(1).toByteArray();
+    }
+    static QByteArray _Data(const QSignalSpy& spy, int i) {
+        return spy.at(i).at(2).toByteArray();
+    }
+
+private slots:
+    void eventStreamSingleEvent();
+    void eventStreamFields();
+    void eventStreamCommentsAndEmptyEvents();
+    void eventStreamCRLFSplitAcrossReads();
+    void eventStreamBareCR();
+    void eventStreamOneByteAtATime();
+    void jsonLines();
+    void jsonLinesTrailingLine();
+};
+
+void
+FQPSubscriptionTest::eventStreamSingleEvent()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    subscription._Append("data: hello\n\n");
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(_Type(spy, 0), FQPSubscription::DefaultEventType);
+    QCOMPARE(_Data(spy, 0), QByteArray("hello"));
+}
+
+void
+FQPSubscriptionTest::eventStreamFields()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    subscription._Append("event: update\n"
+                         "id: 7\n"
+                         "data:first\n"
+                         "data:  second\n"
+                         "retry: 100\n"
+                         "\n"
+                         "data: next\n"
+                         "\n");
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(_Type(spy, 0), QByteArray("update"));
+    QCOMPARE(_Id(spy, 0), QByteArray("7"));
+    // Only one leading space is dropped, and lines are joined with "\n".
+    QCOMPARE(_Data(spy, 0), QByteArray("first\n second"));
+    // The type is per event, the id sticks.
+    QCOMPARE(_Type(spy, 1), FQPSubscription::DefaultEventType);
+    QCOMPARE(_Id(spy, 1), QByteArray("7"));
+    QCOMPARE(subscription.GetLastEventId(), QByteArray("7"));
+}
+
+void
+FQPSubscriptionTest::eventStreamCommentsAndEmptyEvents()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    subscription._Append(": keep-alive\n"
+                         "\n"
+                         "event: ignored\n"
+                         "\n"
+                         "data: x\n");
+    // The keep-alive and the event without data aren't dispatched, and the
+    // last one isn't finished.
+    QCOMPARE(spy.count(), 0);
+    subscription._Append("\n");
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(_Type(spy, 0), FQPSubscription::DefaultEventType);
+    QCOMPARE(_Data(spy, 0), QByteArray("x"));
+}
+
+void
+FQPSubscriptionTest::eventStreamCRLFSplitAcrossReads()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    subscription._Append("data: a\r");
+    subscription._Append("\n\r");
+    QCOMPARE(spy.count(), 0);
+    subscription._Append("\ndata: b\r\n\r\n");
+    // Each "\r\n" is one line break, however it was split.
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(_Data(spy, 0), QByteArray("a"));
+    QCOMPARE(_Data(spy, 1), QByteArray("b"));
+}
+
+void
+FQPSubscriptionTest::eventStreamBareCR()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    subscription._Append("data: a\r\r: comment\r");
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(_Data(spy, 0), QByteArray("a"));
+}
+
+void
+FQPSubscriptionTest::eventStreamOneByteAtATime()
+{
+    QByteArray stream = "id: 1\r\ndata: {\"n\": 1}\r\n\r\n"
+        "data: {\"n\": 2}\n\n";
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(true);
+    for (int i = 0 ; i < stream.size() ; ++i) {
+        subscription._Append(stream.mid(i, 1));
+    }
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(_Data(spy, 0), QByteArray("{\"n\": 1}"));
+    QCOMPARE(_Data(spy, 1), QByteArray("{\"n\": 2}"));
+}
+
+void
+FQPSubscriptionTest::jsonLines()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(false);
+    subscription._Append("{\"a\": 1}\r");
+    subscription._Append("\n\n{\"b\":");
+    QCOMPARE(spy.count(), 1);
+    subscription._Append(" 2}\n");
+    // Blank lines are skipped.
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(_Type(spy, 0), FQPSubscription::DefaultEventType);
+    QCOMPARE(_Data(spy, 0), QByteArray("{\"a\": 1}"));
+    QCOMPARE(_Data(spy, 1), QByteArray("{\"b\": 2}"));
+}
+
+void
+FQPSubscriptionTest::jsonLinesTrailingLine()
+{
+    TestSubscription subscription;
+    QSignalSpy spy(&subscription, &FQPSubscription::EventReceived);
+    subscription._BeginStream(false);
+    subscription._Append("{\"a\": 1}\n{\"b\": 2}");
+    QCOMPARE(spy.count(), 1);
+    // The stream ended without a newline after the last one.
+    subscription._EndStream();
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(_Data(spy, 1), QByteArray("{\"b\": 2}"));
+}
+
+QTEST_GUILESS_MAIN(FQPSubscriptionTest)
+
+#include "tst_FQPSubscription.moc"
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Unit tests. Build from FQPClientAll.pro, so the library is built first,
+# and run them with "make check".
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    FQPCookieStoreTest \
+    FQPFutureTest \
+    FQPJsonPatchTest \
+    FQPMemoryBudgetTest \
+    FQPRedirectTest \
+    FQPRequestJournalTest \
+    FQPSubmissionRingTest \
+    FQPSubscriptionTest \